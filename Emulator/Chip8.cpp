@@ -1,10 +1,24 @@
 #include "Chip8.h"
 #include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+#include <chrono> //for the default seed
+#if defined(LOGOPCODE) || defined(LOGREGISTER)
 #include <iostream>
-#include <chrono> //for random
-#include <sstream>
+#endif
 
 #include "Helpers.h"
+#include "Chip8Jit.h"
+
+//SIMD sprite blitter, SSE2 is always available on x86-64 and AVX2 when the compiler targets it
+#if defined(__AVX2__)
+#define CHIP8_BLIT_AVX2
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define CHIP8_BLIT_SSE2
+#include <emmintrin.h>
+#endif
 
 //#define LOGREGISTER
 //#define LOGOPCODE
@@ -14,33 +28,62 @@ using namespace std;
 //Constructor
 Chip8::Chip8() :
 	m_RunSpeed(1),
-	m_MemoryPosition(0x200),
-	m_StackIndex(0),
-	m_RegisterIndex(0),
+	m_Mode(MODE_CHIP8),
+	m_Backend(BACKEND_INTERPRETER),
+	m_pJit(nullptr),
+	m_pNativeRom(nullptr),
+	m_bNativeBlocks(false),
+	m_GameHash(0),
+	m_Quirks(0),
+	m_Seed(static_cast<U64>(chrono::high_resolution_clock::now().time_since_epoch().count())),
+	m_pHandlers(GetHandlers<0>()),
+	m_pRunThreaded(&Chip8::RunThreaded<0>),
+	m_Memory(nullptr),
+	m_MemorySize(0),
+	m_MemoryMask(0),
+	m_RomSize(0),
+	m_DecodeCache(nullptr),
+	m_CodeMask(0),
+	m_WrittenPages(nullptr),
+	m_FusedCount(0),
+	m_FreeFusedCount(0),
+	m_State(),
+	m_DirtyRows(0),
+	m_MegaScreen(nullptr),
+	m_MegaColors(nullptr),
 	m_bGameLoaded(false),
 	m_bShouldDraw(false),
-	m_bEnableCompatibility(false),
-	m_bEnableScreenWrap(false),
+	m_bShouldBeep(false),
 	m_bPaused(false),
 	m_RunSpeedBeforePause(0)
 {
+	m_State.memoryPosition = 0x200;
+	m_State.pitch = 64;
+	m_State.planes = 1;
 
+	ResizeMemory(4096);
+	MapNativeBlocks();
 }
 
 //Destructor
 Chip8::~Chip8()
 {
-
+	delete m_pJit;
+	delete[] m_Memory;
+	delete[] m_DecodeCache;
+	delete[] m_WrittenPages;
+	delete[] m_MegaScreen;
+	delete[] m_MegaColors;
 }
 
 //Chip8 logic
 void Chip8::Initialize()
 {
 	//reset
-	m_MemoryPosition = 0x200; //first 512 bytes are reserved
+	m_State.memoryPosition = 0x200; //first 512 bytes are reserved
 	m_Opcode = 0;
-	m_RegisterIndex = 0;
-	m_StackIndex = 0;
+	m_State.registerIndex = 0;
+	m_State.stackIndex = 0;
 
 	//load font set
 	U8 fonts[80] =
@@ -63,715 +106,2541 @@ void Chip8::Initialize()
 		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 	};
 
-	//clear memory
-	for (int i = 0; i < 4096; ++i)
+	//SuperChip 8x10 font, FX30
+	U8 bigFonts[160] =
+	{
+		0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+		0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+		0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+		0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+		0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+		0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+		0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+		0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+	};
+
+	//clear memory, XO-CHIP addresses 64 KB and MegaChip as much as the rom needs
+	ResizeMemory(GetModeMemorySize());
+	for (int i = 0; i < m_MemorySize; ++i)
 	{
 		m_Memory[i] = 0;
 	}
 
+	//the whole memory changed, decode everything again. The cache may be new, so the pool is emptied instead of freed slot by slot
+	InvalidateCode(0, m_MemorySize);
+	m_FusedCount = 0;
+	m_FreeFusedCount = 0;
+
 	//load fonts in memory
 	for (int i = 0; i < 80; i++)
 	{
 		m_Memory[i] = fonts[i];
 	}
 
+	for (int i = 0; i < 160; i++)
+	{
+		m_Memory[BIG_FONT_ADDRESS + i] = bigFonts[i];
+	}
+
 	//Clear register, keys and stack
 	for (int i = 0; i < 16; ++i)
 	{
-		m_Register[i] = 0;
-		m_Keys[i] = 0;
-		m_Stack[i] = 0;
+		m_State.registers[i] = 0;
+		m_State.keys[i] = 0;
+		m_State.stack[i] = 0;
+		m_State.userFlags[i] = 0;
+		m_State.audioPattern[i] = 0;
 	}
-
-	//Reset Screen
-	ClearScreen();
+	m_State.pitch = 64;
+
+	//Reset Screen, games start in lores and draw to the first plane
+	m_State.bHires = false;
+	m_State.planes = 1;
+	ClearScreen((1 << PLANES) - 1);
+
+	//MegaChip games switch their screen on with 0011, colors that weren't loaded are white
+	m_State.bMegaChip = false;
+	m_State.megaFront = 0;
+	m_State.palette[0] = 0xFF000000;
+	for (int i = 1; i < 256; i++)
+	{
+		m_State.palette[i] = 0xFFFFFFFF;
+	}
+	m_State.spriteWidth = 0;
+	m_State.spriteHeight = 0;
+	m_State.screenAlpha = 255;
+	m_State.blendMode = BLEND_NORMAL;
+	m_State.collisionColor = 0;
+	m_State.sampleAddress = 0;
+	m_State.bSampleLoop = false;
+	m_State.bSamplePlaying = false;
 
 	//reset Delay Timer
-	m_DelayTimer = 0;
-	m_SoundTimer = 0;
+	m_State.delayTimer = 0;
+	m_State.soundTimer = 0;
+	m_State.timerCycle = m_State.cycles;
+	m_State.random = SeedRandom(m_Seed);
 
 	//reset flags
 	m_bShouldDraw = false;
-	//m_bEnableCompatibility = false;
-	m_bEnableScreenWrap = false;
+	m_bShouldBeep = false;
 	m_bPaused = false;
-
-	//seed random for true random numbers
-	srand(static_cast<unsigned int>(time(nullptr)));
+	SetQuirks(m_Quirks & ~QUIRK_WRAP);
 }
 
 void Chip8::CreateOpcode()
 {
 	//char = 1 byte, opcode is 2 bytes
 	//we need to combine current memory position + next memory position using an OR bitwise operation
-	U16 opcode;
+	m_Opcode = ReadWord(m_State.memoryPosition);
+}
 
-	//get byte at current location in memory
-	opcode = m_Memory[m_MemoryPosition];
+//Handler of every OpcodeId for one combination of quirks
+template<unsigned int QUIRKS>
+const Chip8::OpcodeHandler* Chip8::GetHandlers()
+{
+	static const OpcodeHandler handlers[OP_COUNT] =
+	{
+		&Chip8::OpUnknown,
+		&Chip8::Op00E0, &Chip8::Op00EE, &Chip8::Op1NNN, &Chip8::Op2NNN, &Chip8::Op3XNN, &Chip8::Op4XNN, &Chip8::Op5XY0, &Chip8::Op6XNN, &Chip8::Op7XNN,
+		&Chip8::Op8XY0, &Chip8::Op8XY1<QUIRKS>, &Chip8::Op8XY2<QUIRKS>, &Chip8::Op8XY3<QUIRKS>, &Chip8::Op8XY4, &Chip8::Op8XY5, &Chip8::Op8XY6<QUIRKS>, &Chip8::Op8XY7, &Chip8::Op8XYE<QUIRKS>,
+		&Chip8::Op9XY0, &Chip8::OpANNN, &Chip8::OpBNNN<QUIRKS>, &Chip8::OpCXNN, &Chip8::OpDXYN<QUIRKS>, &Chip8::OpEX9E, &Chip8::OpEXA1,
+		&Chip8::OpFX07, &Chip8::OpFX0A, &Chip8::OpFX15, &Chip8::OpFX18, &Chip8::OpFX1E, &Chip8::OpFX29, &Chip8::OpFX33, &Chip8::OpFX55<QUIRKS>, &Chip8::OpFX65<QUIRKS>,
+		&Chip8::Op00CN, &Chip8::Op00FB, &Chip8::Op00FC, &Chip8::Op00FD, &Chip8::Op00FE, &Chip8::Op00FF, &Chip8::OpFX30, &Chip8::OpFX75, &Chip8::OpFX85,
+		&Chip8::Op00DN, &Chip8::Op5XY2, &Chip8::Op5XY3, &Chip8::OpF000, &Chip8::OpFN01, &Chip8::OpF002, &Chip8::OpFX3A,
+		&Chip8::Op0010, &Chip8::Op0011, &Chip8::Op00BN, &Chip8::Op01NN, &Chip8::Op02NN, &Chip8::Op03NN, &Chip8::Op04NN, &Chip8::Op05NN, &Chip8::Op060N, &Chip8::Op0700, &Chip8::Op080N, &Chip8::Op09NN,
+		&Chip8::OpANNN_DXYN<QUIRKS>, &Chip8::Op6XNN_6YNN, &Chip8::Op7XNN_3XNN_1NNN, &Chip8::OpFX07_3XNN_1NNN
+	};
+
+	return handlers;
+}
+
+//Specializations of every combination of quirks, indexed by the quirk flags
+#define QUIRK_SET(quirks) { &Chip8::GetHandlers<quirks>, &Chip8::RunThreaded<quirks> }
+
+const Chip8::QuirkSet Chip8::s_QuirkSets[QUIRK_COUNT] =
+{
+	QUIRK_SET(0), QUIRK_SET(1), QUIRK_SET(2), QUIRK_SET(3), QUIRK_SET(4), QUIRK_SET(5), QUIRK_SET(6), QUIRK_SET(7),
+	QUIRK_SET(8), QUIRK_SET(9), QUIRK_SET(10), QUIRK_SET(11), QUIRK_SET(12), QUIRK_SET(13), QUIRK_SET(14), QUIRK_SET(15),
+	QUIRK_SET(16), QUIRK_SET(17), QUIRK_SET(18), QUIRK_SET(19), QUIRK_SET(20), QUIRK_SET(21), QUIRK_SET(22), QUIRK_SET(23),
+	QUIRK_SET(24), QUIRK_SET(25), QUIRK_SET(26), QUIRK_SET(27), QUIRK_SET(28), QUIRK_SET(29), QUIRK_SET(30), QUIRK_SET(31)
+};
 
-	//shift current byte 8 bits to the left
-	opcode = opcode << 8;
+#undef QUIRK_SET
 
-	//read next byte in memory and OR to add them together
-	m_Opcode = opcode | m_Memory[m_MemoryPosition + 1];
+//Decode table, built once before main() runs
+Chip8::Instruction Chip8::s_DecodeTable[0x10000];
+bool Chip8::s_bDecodeTableBuilt = Chip8::BuildDecodeTable();
+
+bool Chip8::BuildDecodeTable()
+{
+	for (int opcode = 0; opcode < 0x10000; ++opcode)
+	{
+		s_DecodeTable[opcode] = Decode(static_cast<U16>(opcode));
+	}
+
+	return true;
 }
 
-void Chip8::ExecuteOpcode()
+Chip8::Instruction Chip8::Decode(U16 opcode)
 {
-	CreateOpcode();
-	PrintOpcode();
+	Instruction ins;
+
+	//extract all operands once so the handlers don't need to mask the opcode
+	ins.opcode = opcode;
+	ins.nnn = opcode & 0x0FFF;
+	ins.x = (opcode & 0x0F00) >> 8; //change 0X00 to 000X
+	ins.y = (opcode & 0x00F0) >> 4; //change 00Y0 to 000Y
+	ins.n = opcode & 0x000F;
+	ins.nn = opcode & 0x00FF;
+	ins.nn2 = 0;
+	ins.length = 1;
+	ins.op = OP_UNKNOWN;
 
 	//mask to the opcode to switch on the first bit
-	switch (m_Opcode & 0xF000)
-	{
-	case 0x000:
+	switch (opcode & 0xF000)
 	{
-		switch (m_Opcode & 0x000F)
+	case 0x0000:
+		//SuperChip, XO-CHIP and MegaChip opcodes, the other 0NNN machine code calls keep the loose match on the last nibble
+		switch (opcode & 0xFFF0)
 		{
-		case 0x0000: //0x00E0 clear screen
+		case 0x00B0: ins.op = OP_00BN; break;
+		case 0x00C0: ins.op = OP_00CN; break;
+		case 0x00D0: ins.op = OP_00DN; break;
+		case 0x0600: ins.op = OP_060N; break;
+		case 0x0800: ins.op = OP_080N; break;
+		}
+
+		switch (opcode & 0xFF00)
 		{
-			//Reset Screen
-			ClearScreen();
+		case 0x0100: ins.op = OP_01NN; break;
+		case 0x0200: ins.op = OP_02NN; break;
+		case 0x0300: ins.op = OP_03NN; break;
+		case 0x0400: ins.op = OP_04NN; break;
+		case 0x0500: ins.op = OP_05NN; break;
+		case 0x0900: ins.op = OP_09NN; break;
+		}
 
-			m_MemoryPosition += 2;
+		if (ins.op != OP_UNKNOWN)
+		{
 			break;
 		}
 
-		case 0x000E: //0x00EE. Return from a subroutine
+		switch (opcode)
 		{
-			//return to last position in the stack and reduce the stack index
-			m_MemoryPosition = PopStack();
+		case 0x0010: ins.op = OP_0010; break;
+		case 0x0011: ins.op = OP_0011; break;
+		case 0x0700: ins.op = OP_0700; break;
+		case 0x00FB: ins.op = OP_00FB; break;
+		case 0x00FC: ins.op = OP_00FC; break;
+		case 0x00FD: ins.op = OP_00FD; break;
+		case 0x00FE: ins.op = OP_00FE; break;
+		case 0x00FF: ins.op = OP_00FF; break;
+		default:
+			switch (opcode & 0x000F)
+			{
+			case 0x0000: ins.op = OP_00E0; break;
+			case 0x000E: ins.op = OP_00EE; break;
+			}
 			break;
 		}
-		}
-
 		break;
-	}
 
-	case 0x1000: //1NNN jump to address NNN
-	{
-		U16 n = m_Opcode & 0x0FFF;
-		m_MemoryPosition = n;
+	case 0x1000: ins.op = OP_1NNN; break;
+	case 0x2000: ins.op = OP_2NNN; break;
+	case 0x3000: ins.op = OP_3XNN; break;
+	case 0x4000: ins.op = OP_4XNN; break;
+	case 0x5000:
+		switch (opcode & 0x000F)
+		{
+		case 0x0002: ins.op = OP_5XY2; break;
+		case 0x0003: ins.op = OP_5XY3; break;
+		default: ins.op = OP_5XY0; break;
+		}
 		break;
-	}
-
-	case 0x2000: //2NNN call subroutine at NNN
-	{
-		U16 n = m_Opcode & 0x0FFF;
-
-		//Store next memory position in the stack and increment the stack
-		m_MemoryPosition += 2;
-		PushStack(m_MemoryPosition);
 
-		//go to the new memory position
-		m_MemoryPosition = n;
+	case 0x6000: ins.op = OP_6XNN; break;
+	case 0x7000: ins.op = OP_7XNN; break;
 
+	case 0x8000:
+		//Sub division for this opcode
+		switch (opcode & 0x000F)
+		{
+		case 0x0000: ins.op = OP_8XY0; break;
+		case 0x0001: ins.op = OP_8XY1; break;
+		case 0x0002: ins.op = OP_8XY2; break;
+		case 0x0003: ins.op = OP_8XY3; break;
+		case 0x0004: ins.op = OP_8XY4; break;
+		case 0x0005: ins.op = OP_8XY5; break;
+		case 0x0006: ins.op = OP_8XY6; break;
+		case 0x0007: ins.op = OP_8XY7; break;
+		case 0x000E: ins.op = OP_8XYE; break;
+		}
 		break;
-	}
-
-	case 0x3000: //3XNN skip next instruction if m_Register[X] == NN
-	{
-		U16 x = (m_Opcode & 0x0F00) >> 8; //change 0X00 0000 to 000X 
-		U8 n = m_Opcode & 0x00FF;
 
-		U8 registerX = GetRegisterData(x);
+	case 0x9000: ins.op = OP_9XY0; break;
+	case 0xA000: ins.op = OP_ANNN; break;
+	case 0xB000: ins.op = OP_BNNN; break;
+	case 0xC000: ins.op = OP_CXNN; break;
+	case 0xD000: ins.op = OP_DXYN; break;
 
-		if (registerX == n)
+	case 0xE000:
+		switch (opcode & 0x00FF)
 		{
-			m_MemoryPosition += 4; //skip next instruction
+		case 0x009E: ins.op = OP_EX9E; break;
+		case 0x00A1: ins.op = OP_EXA1; break;
 		}
-		else
+		break;
+
+	case 0xF000: //multiple options
+		switch (opcode & 0x00FF)
 		{
-			m_MemoryPosition += 2; //go to next instruction
+		case 0x0000: ins.op = (ins.x == 0) ? OP_F000 : OP_UNKNOWN; break;
+		case 0x0001: ins.op = OP_FN01; break;
+		case 0x0002: ins.op = (ins.x == 0) ? OP_F002 : OP_UNKNOWN; break;
+		case 0x0007: ins.op = OP_FX07; break;
+		case 0x000A: ins.op = OP_FX0A; break;
+		case 0x0015: ins.op = OP_FX15; break;
+		case 0x0018: ins.op = OP_FX18; break;
+		case 0x001E: ins.op = OP_FX1E; break;
+		case 0x0029: ins.op = OP_FX29; break;
+		case 0x0030: ins.op = OP_FX30; break;
+		case 0x0033: ins.op = OP_FX33; break;
+		case 0x003A: ins.op = OP_FX3A; break;
+		case 0x0055: ins.op = OP_FX55; break;
+		case 0x0065: ins.op = OP_FX65; break;
+		case 0x0075: ins.op = OP_FX75; break;
+		case 0x0085: ins.op = OP_FX85; break;
 		}
 		break;
 	}
 
-	case 0x4000: //4XNN skip the next instruction if m_Register[X] != NN
+	return ins;
+}
+
+//Returns the instruction at the current memory position, superinstructions are only returned when they
+//contain at most maxLength opcodes
+inline const Chip8::Instruction& Chip8::FetchInstruction(int maxLength)
+{
+	//decode the opcode the first time this address is executed
+	const Instruction*& cached = m_DecodeCache[m_State.memoryPosition & m_CodeMask];
+	if (cached == nullptr)
 	{
-		U16 x = (m_Opcode & 0x0F00) >> 8; //change 0X00 0000 to 000X 
-		U8 n = m_Opcode & 0x00FF;
-		U8 registerX = GetRegisterData(x);
+		CreateOpcode();
+		cached = Fuse(m_State.memoryPosition, &s_DecodeTable[m_Opcode]);
+	}
 
-		if (registerX != n)
-		{
-			m_MemoryPosition += 4; //skip next instruction
-		}
-		else
-		{
-			m_MemoryPosition += 2; //go to next instruction
-		}
+	m_Opcode = cached->opcode;
+	PrintOpcode();
 
-		break;
+	if (cached->length > maxLength)
+	{
+		return s_DecodeTable[m_Opcode];
 	}
 
-	case 0x5000: //5XY0 skip the next instruction if m_Register[X] == m_Register[Y]
+	return *cached;
+}
+
+//Executes a single opcode
+void Chip8::ExecuteOpcode()
+{
+	const Instruction& ins = FetchInstruction(1);
+
+	//one indexed load and one indirect call
+	(this->*m_pHandlers[ins.op])(ins);
+}
+
+const Chip8::Instruction* Chip8::Fuse(U16 address, const Instruction* ins)
+{
+	//the following opcodes have to be in memory
+	if ((m_FreeFusedCount == 0 && m_FusedCount >= MAX_FUSED) || address + MAX_FUSED_LENGTH * 2 > m_MemorySize)
 	{
-		U16 x = (m_Opcode & 0x0F00) >> 8; //change 0X00 0000 to 000X 
-		U16 y = (m_Opcode & 0x00F0) >> 4;
-		U8 registerX = GetRegisterData(x);
-		U8 registerY = GetRegisterData(y);
+		return ins;
+	}
+
+	const Instruction& second = s_DecodeTable[ReadWord(address + 2)];
+	const Instruction& third = s_DecodeTable[ReadWord(address + 4)];
 
-		if (registerX == registerY)
+	Instruction fused = *ins;
+	switch (ins->op)
+	{
+	case OP_ANNN: //ANNN; DXYN sprite draw
+		if (second.op == OP_DXYN)
 		{
-			m_MemoryPosition += 4; //skip next instruction
+			fused.op = OP_ANNN_DXYN;
+			fused.x = second.x;
+			fused.y = second.y;
+			fused.n = second.n;
+			fused.length = 2;
 		}
-		else
+		break;
+
+	case OP_6XNN: //6XNN; 6YNN register setup
+		if (second.op == OP_6XNN)
 		{
-			m_MemoryPosition += 2; //go to next instruction
+			fused.op = OP_6XNN_6YNN;
+			fused.y = second.x;
+			fused.nn2 = second.nn;
+			fused.length = 2;
 		}
+		break;
 
+	case OP_7XNN: //7XNN; 3XNN; 1NNN counter loop
+	case OP_FX07: //FX07; 3XNN; 1NNN delay timer wait
+		if (second.op == OP_3XNN && second.x == ins->x && third.op == OP_1NNN)
+		{
+			fused.op = (ins->op == OP_7XNN) ? OP_7XNN_3XNN_1NNN : OP_FX07_3XNN_1NNN;
+			fused.nn2 = second.nn;
+			fused.nnn = third.nnn;
+			fused.length = 3;
+		}
 		break;
 	}
 
-	case 0x6000: //6XNN set m_Register[X] to NN
+	if (fused.length == 1)
 	{
-		U16 x = (m_Opcode & 0x0F00) >> 8;
-		U8 n = m_Opcode & 0x00FF;
-
-		m_Register[x] = n;
-		m_MemoryPosition += 2;
-		break;
+		return ins;
 	}
-	case 0x7000: //7XNN Adds NN to m_Register[X]
-	{
-		U8 x = (m_Opcode & 0x0F00) >> 8;
-		U8 n = m_Opcode & 0x00FF;
 
-		m_Register[x] += n;
-		m_MemoryPosition += 2;
-		break;
+	//slots of invalidated superinstructions are reused, rewriting code doesn't use the pool up
+	int slot = (m_FreeFusedCount > 0) ? m_FreeFused[--m_FreeFusedCount] : m_FusedCount++;
+	m_FusedPool[slot] = fused;
+	return &m_FusedPool[slot];
+}
+
+void Chip8::InvalidateCode(int address, int length)
+{
+	if (m_pJit != nullptr)
+	{
+		m_pJit->Invalidate(address, length);
 	}
 
-	case 0x8000:
-		//Sub division for this opcode
-		switch (m_Opcode & 0x000F)
-		{
-		case 0x0000: //8XY0 set m_Register[X] to the value of m_Register[Y]
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
+	InvalidateNativeBlocks(address, length);
 
-			U8 registerY = GetRegisterData(y);
+	//every write to memory comes through here, ForkPool only looks at the pages that were written
+	int pageMask = m_MemoryMask >> PAGE_SHIFT;
+	for (int page = address >> PAGE_SHIFT; page <= (address + length - 1) >> PAGE_SHIFT; ++page)
+	{
+		int written = page & pageMask;
+		m_WrittenPages[written / 64] |= 1ULL << (written & 63);
+	}
 
-			m_Register[x] = registerY;
-			m_MemoryPosition += 2;
-			break;
-		}
+	//an opcode is 2 bytes, the one starting at the previous address overlaps the first written byte.
+	//superinstructions that start up to 2 opcodes earlier contain it as well
+	int start = address - (MAX_FUSED_LENGTH * 2 - 1);
+	int end = address + length;
 
-		case 0x0001: //8XY1 set m_Registers[X] to the value of m_Registers[X] OR m_Registers[Y]
+	for (int i = start; i < end; ++i)
+	{
+		//memory above 64 KB is never executed
+		int written = i & m_MemoryMask;
+		if (written <= m_CodeMask)
 		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
-
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
-
-			m_Register[x] = registerX | registerY;
-			m_MemoryPosition += 2;
-			break;
+			//a superinstruction is only pointed to by the address it starts at, its slot is free again
+			const Instruction* cached = m_DecodeCache[written];
+			if (cached >= m_FusedPool && cached < m_FusedPool + MAX_FUSED)
+			{
+				m_FreeFused[m_FreeFusedCount++] = static_cast<int>(cached - m_FusedPool);
+			}
 
+			m_DecodeCache[written] = nullptr;
 		}
-		case 0x0002: //8XY2 sets m_Register[X] to m_Register[X] AND m_Register[Y]
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
+	}
+}
 
-			m_Register[x] = registerX & registerY;
-			m_MemoryPosition += 2;
-			break;
-		}
+//Opcodes
+#pragma region Opcodes
+void Chip8::OpUnknown(const Instruction&)
+{
+	//unsupported opcode, the memory position doesn't change
+}
 
-		case 0x0003: //8XY3 sets m_Register[X] to m_Register[X] XOR m_Register[Y]
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
+void Chip8::Op00E0(const Instruction&) //00E0 clear screen, MegaChip shows the buffer that was drawn and clears the next one
+{
+	if (m_State.bMegaChip)
+	{
+		m_State.megaFront ^= 1;
+		memset(GetMegaBack(), 0, MEGA_SIZE);
+		memset(GetMegaBackColors(), 0, MEGA_SIZE * sizeof(U32));
 
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
+		m_DirtyRows = ~0ULL;
+		m_bShouldDraw = true;
+	}
+	else
+	{
+		//Reset Screen
+		ClearScreen(m_State.planes);
+	}
 
-			m_Register[x] = registerX ^registerY;
-			m_MemoryPosition += 2;
-			break;
-		}
+	m_State.memoryPosition += 2;
+}
 
-		case 0x0004: //8XY4 Adds _Register[Y] to  m_Register[X].  
-					 //		m_Register[0xF] is set to 1 when there's a carry, and to 0 when there isn't	
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
+void Chip8::Op00EE(const Instruction&) //00EE. Return from a subroutine
+{
+	//return to last position in the stack and reduce the stack index
+	m_State.memoryPosition = PopStack();
+}
 
-			bool bCarry = registerY > registerX;
-			m_Register[0xF] = bCarry ? 1 : 0;
-			m_Register[x] += registerY;
+void Chip8::Op1NNN(const Instruction& ins) //1NNN jump to address NNN
+{
+	m_State.memoryPosition = ins.nnn;
+}
 
-			m_MemoryPosition += 2;
-			break;
-		}
+void Chip8::Op2NNN(const Instruction& ins) //2NNN call subroutine at NNN
+{
+	//Store next memory position in the stack and increment the stack
+	m_State.memoryPosition += 2;
+	PushStack(m_State.memoryPosition);
 
-		case 0x0005: //8XY5 m_Register[Y] is subtracted from m_Register[X]
-					 //		set m_Register[0xF] to 0 when there is a borrow and to 1 when there isn`t
-					 //		a borrow occurs whenever the subtrahend is greater than the minuend.
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 y = (m_Opcode & 0x0F0) >> 4;
+	//go to the new memory position
+	m_State.memoryPosition = ins.nnn;
+}
 
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
+void Chip8::Op3XNN(const Instruction& ins) //3XNN skip next instruction if m_State.registers[X] == NN
+{
+	U8 registerX = GetRegisterData(ins.x);
 
-			bool bBurrow = registerY > registerX;
-			m_Register[0xF] = bBurrow ? 0 : 1;
-			m_Register[x] = registerX - registerY;
+	if (registerX == ins.nn)
+	{
+		m_State.memoryPosition += GetSkipLength(); //skip next instruction
+	}
+	else
+	{
+		m_State.memoryPosition += 2; //go to next instruction
+	}
+}
 
-			m_MemoryPosition += 2;
-			break;
-		}
-		case 0x0006: //8XY6 shifts m_Register[X] right by one
-					 //		set m_Register[0xF]least significant bit of m_Register[X] before the shift
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 registerX = GetRegisterData(x);
+void Chip8::Op4XNN(const Instruction& ins) //4XNN skip the next instruction if m_State.registers[X] != NN
+{
+	U8 registerX = GetRegisterData(ins.x);
 
-			m_Register[0xF] = registerX & 0x1; //get least significant bit		
-			m_Register[x] = registerX >> 1; //shift right
+	if (registerX != ins.nn)
+	{
+		m_State.memoryPosition += GetSkipLength(); //skip next instruction
+	}
+	else
+	{
+		m_State.memoryPosition += 2; //go to next instruction
+	}
+}
 
-			m_MemoryPosition += 2;
-			break;
-		}
+void Chip8::Op5XY0(const Instruction& ins) //5XY0 skip the next instruction if m_State.registers[X] == m_State.registers[Y]
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-		case 0x0007: //8XY7 Set m_Register[X] to m_Register[Y] - m_Register[X]
-					 //		set m_Register[0xF] to 0 if there is a burrow and 1 when there isn`t
-		{
-			U16 x = (m_Opcode & 0xF00) >> 8;
-			U16 y = (m_Opcode & 0xF00) >> 4;
-			U8 registerX = GetRegisterData(x);
-			U8 registerY = GetRegisterData(y);
+	if (registerX == registerY)
+	{
+		m_State.memoryPosition += GetSkipLength(); //skip next instruction
+	}
+	else
+	{
+		m_State.memoryPosition += 2; //go to next instruction
+	}
+}
 
-			//Is there a burrow
-			bool bBurrow = registerX > registerY;
-			m_Register[0xF] = (bBurrow) ? 0 : 1;
+void Chip8::Op6XNN(const Instruction& ins) //6XNN set m_State.registers[X] to NN
+{
+	m_State.registers[ins.x] = ins.nn;
+	m_State.memoryPosition += 2;
+}
 
-			//set register to register[y] - register[x]
-			m_Register[x] = registerY - registerX;
+void Chip8::Op7XNN(const Instruction& ins) //7XNN Adds NN to m_State.registers[X]
+{
+	m_State.registers[ins.x] += ins.nn;
+	m_State.memoryPosition += 2;
+}
 
-			m_MemoryPosition += 2;
-			break;
-		}
-		case 0x000E: //8XYE shifts m_Register[X] left by one
-					 //		set m_Register[0xF]least significant bit of m_Register[X] before the shift
-		{
-			U8 x = (m_Opcode & 0xF00) >> 8;
-			U8 registerX = GetRegisterData(x);
+void Chip8::Op8XY0(const Instruction& ins) //8XY0 set m_State.registers[X] to the value of m_State.registers[Y]
+{
+	U8 registerY = GetRegisterData(ins.y);
 
-			m_Register[0xF] = registerX & 0x1; //get least significant bit	
-			m_Register[x] = registerX << 1; //shift right
+	m_State.registers[ins.x] = registerY;
+	m_State.memoryPosition += 2;
+}
 
-			m_MemoryPosition += 2;
-			break;
-		}
-		}
-		break;
-	case 0x9000: //9XY0 skip the next instruction if m_Registers[X] doesn't equal m_Registers[Y]
-	{
-		U8 x = (m_Opcode & 0x0F00) >> 8;
-		U8 y = (m_Opcode & 0x00F0) >> 4;
+template<unsigned int QUIRKS>
+void Chip8::Op8XY1(const Instruction& ins) //8XY1 set m_Registers[X] to the value of m_Registers[X] OR m_Registers[Y]
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-		if (GetRegisterData(x) != GetRegisterData(y))
-		{
-			m_MemoryPosition += 4;
-		}
-		else
-		{
-			m_MemoryPosition += 2;
-		}
+	m_State.registers[ins.x] = registerX | registerY;
 
-		break;
+	if (QUIRKS & QUIRK_VF_RESET)
+	{
+		m_State.registers[0xF] = 0;
 	}
 
-	case 0xA000: //ANNN set RegisterIndex to NNN
-	{
-		U16 n = m_Opcode & 0x0FFF;
+	m_State.memoryPosition += 2;
+}
 
-		m_RegisterIndex = n; //access NNN
-		m_MemoryPosition += 2;
-		break;
-	}
+template<unsigned int QUIRKS>
+void Chip8::Op8XY2(const Instruction& ins) //8XY2 sets m_State.registers[X] to m_State.registers[X] AND m_State.registers[Y]
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-	case 0xB000: //BNNN jump to address NNN + m_Register[0]
+	m_State.registers[ins.x] = registerX & registerY;
+
+	if (QUIRKS & QUIRK_VF_RESET)
 	{
-		U16 n = m_Opcode & 0x0FFF;
-		m_MemoryPosition = n + m_Register[0];
-		break;
+		m_State.registers[0xF] = 0;
 	}
 
-	case 0xC000: //CXNN Sets m_Register[X] to rand() AND NN
-	{
-		U8 x = (m_Opcode & 0x0F00) >> 8;
-		U8 n = m_Opcode & 0x00FF;
+	m_State.memoryPosition += 2;
+}
 
-		//limit rand value to 255
-		U8 rnd = rand() % 0xFF;
-		m_Register[x] = rnd & n;
-		m_MemoryPosition += 2;
-		break;
-	}
+template<unsigned int QUIRKS>
+void Chip8::Op8XY3(const Instruction& ins) //8XY3 sets m_State.registers[X] to m_State.registers[X] XOR m_State.registers[Y]
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
+
+	m_State.registers[ins.x] = registerX ^ registerY;
 
-	case 0xD000: // DXYN: Draws a sprite at (VX, VY), width = 8 pixels and a height = N pixels. 
-				 // Each row of 8 pixels is read as bit-coded starting from memory location I; 
-				 // RegisterIndex value doesn't change after the execution of this instruction. 
-				 // m_Register[0xF] is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, 
-				 // and to 0 if that doesn't happen
+	if (QUIRKS & QUIRK_VF_RESET)
 	{
-		//get required data from the opcode
-		U8 x = (m_Opcode & 0xF00) >> 8;
-		U8 y = (m_Opcode & 0x0F0) >> 4;
-		U8 n = m_Opcode & 0x00F;
+		m_State.registers[0xF] = 0;
+	}
 
-		U16 height = n; //height of the sprite
-		U16 xPos = GetRegisterData(x);; //start position X
-		U16 yPos = GetRegisterData(y);; //start position Y
+	m_State.memoryPosition += 2;
+}
 
-		DrawPixel(xPos, yPos, height);
+void Chip8::Op8XY4(const Instruction& ins) //8XY4 Adds _Register[Y] to  m_State.registers[X].
+										   //		m_State.registers[0xF] is set to 1 when there's a carry, and to 0 when there isn't
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-		m_MemoryPosition += 2;
-		break;
-	}
+	bool bCarry = registerX + registerY > 0xFF;
+	m_State.registers[0xF] = bCarry ? 1 : 0;
+	m_State.registers[ins.x] += registerY;
 
-	case 0xE000:
-	{
-		switch (m_Opcode & 0x00FF)
-		{
-		case 0x009E: //EX9E Skips the next instruction if the key stored in m_Register[X] is pressed
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			U8 registerData = GetRegisterData(x);
-			if (IsKeyPressed(registerData)) //pressed
-			{
-				m_MemoryPosition += 4;
-			}
-			else
-			{
-				m_MemoryPosition += 2;
-			}
-			break;
-		}
+	m_State.memoryPosition += 2;
+}
 
-		case 0x00A1: //EXA1 Skips the next instruction if the key stored in m_Register[X] isn`t pressed
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			U8 registerData = GetRegisterData(x);
-			if (!IsKeyPressed(registerData)) //not pressed
-			{
-				m_MemoryPosition += 4;
-			}
-			else
-			{
-				m_MemoryPosition += 2;
-			}
+void Chip8::Op8XY5(const Instruction& ins) //8XY5 m_State.registers[Y] is subtracted from m_State.registers[X]
+										   //		set m_State.registers[0xF] to 0 when there is a borrow and to 1 when there isn`t
+										   //		a borrow occurs whenever the subtrahend is greater than the minuend.
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-			break;
-		}
-		}
-		break;
-	}
+	bool bBurrow = registerY > registerX;
+	m_State.registers[0xF] = bBurrow ? 0 : 1;
+	m_State.registers[ins.x] = registerX - registerY;
 
-	case 0xF000: //multiple options
-	{
-		switch (m_Opcode & 0x00FF)
-		{
-		case 0x0007: //FX07 set m_Registers[X] to the value of the delay timer
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			m_Register[x] = m_DelayTimer;
-			m_MemoryPosition += 2;
-			break;
-		}
+	m_State.memoryPosition += 2;
+}
 
-		case 0x0015: //FX15 set the delay timer to m_Registers[X]
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			m_DelayTimer = GetRegisterData(x);
-			m_MemoryPosition += 2;
-			break;
-		}
+template<unsigned int QUIRKS>
+void Chip8::Op8XY6(const Instruction& ins) //8XY6 shifts m_State.registers[X] right by one
+										   //		set m_State.registers[0xF]least significant bit of m_State.registers[X] before the shift
+{
+	//with the shift quirk m_State.registers[Y] is shifted instead
+	U8 registerX = GetRegisterData((QUIRKS & QUIRK_SHIFT) ? ins.y : ins.x);
 
-		case 0x0018: //FX15 set the sound timer to m_Registers[X]
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			m_SoundTimer = GetRegisterData(x);
-			m_MemoryPosition += 2;
-			break;
-		}
+	m_State.registers[0xF] = registerX & 0x1; //get least significant bit
+	m_State.registers[ins.x] = registerX >> 1; //shift right
 
-		case 0x0029: //FX15 Sets m_RegisterIndex to the location of the sprite for the character m_Register[X]
-					 //		Characters 0-F are represented by a 4x5 font
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			m_RegisterIndex = GetRegisterData(x) * 5;
-			m_MemoryPosition += 2;
-			break;
-		}
+	m_State.memoryPosition += 2;
+}
 
-		case 0x0033: //FX33 store the Binary Coded decimal representation of m_Register[X] with the most significant of three digits at the address in m_RegisterIndex
-					 //		the middle digit at _RegisterIndex +1 and the least significant digit at m_RegisterIndex +2. In other words take the decimal representation 
-					 //		of m_Registers[X] place the hundreds digit in memory at the location in m_RegisterIndex the tens digit in m-_RegisterIndex +1 
-					 //		and the ones digit in m_RegisterIndex +2 
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
-			U8 value = GetRegisterData(x);
+void Chip8::Op8XY7(const Instruction& ins) //8XY7 Set m_State.registers[X] to m_State.registers[Y] - m_State.registers[X]
+										   //		set m_State.registers[0xF] to 0 if there is a burrow and 1 when there isn`t
+{
+	U8 registerX = GetRegisterData(ins.x);
+	U8 registerY = GetRegisterData(ins.y);
 
-			U8 mostSignificant = value / 100;
-			U8 middle = (value / 10) % 10;
-			U8 least = (value % 100) % 10;
+	//Is there a burrow
+	bool bBurrow = registerX > registerY;
+	m_State.registers[0xF] = (bBurrow) ? 0 : 1;
 
-			m_Memory[m_RegisterIndex] = mostSignificant;
-			m_Memory[m_RegisterIndex + 1] = middle;
-			m_Memory[m_RegisterIndex + 2] = least;
+	//set register to register[y] - register[x]
+	m_State.registers[ins.x] = registerY - registerX;
 
-			m_MemoryPosition += 2;
+	m_State.memoryPosition += 2;
+}
 
-			break;
-		}
+template<unsigned int QUIRKS>
+void Chip8::Op8XYE(const Instruction& ins) //8XYE shifts m_State.registers[X] left by one
+										   //		set m_State.registers[0xF]least significant bit of m_State.registers[X] before the shift
+{
+	//with the shift quirk m_State.registers[Y] is shifted instead
+	U8 registerX = GetRegisterData((QUIRKS & QUIRK_SHIFT) ? ins.y : ins.x);
 
-		case 0x000A: //FX0A a key press is awaited and then stored in m_Registers[X]
-		{
-			bool bKeyPressed = false;
+	m_State.registers[0xF] = registerX & 0x1; //get least significant bit
+	m_State.registers[ins.x] = registerX << 1; //shift right
 
-			U8 x = (m_Opcode & 0x0F00) >> 8;
+	m_State.memoryPosition += 2;
+}
 
-			//look for a pressed key and store it in the register
-			for (U8 i = 0; i < 16; i++)
-			{
-				if (m_Keys[i] != 0)
+void Chip8::Op9XY0(const Instruction& ins) //9XY0 skip the next instruction if m_Registers[X] doesn't equal m_Registers[Y]
+{
+	if (GetRegisterData(ins.x) != GetRegisterData(ins.y))
+	{
+		m_State.memoryPosition += GetSkipLength();
+	}
+	else
+	{
+		m_State.memoryPosition += 2;
+	}
+}
+
+void Chip8::OpANNN(const Instruction& ins) //ANNN set RegisterIndex to NNN
+{
+	m_State.registerIndex = ins.nnn; //access NNN
+	m_State.memoryPosition += 2;
+}
+
+template<unsigned int QUIRKS>
+void Chip8::OpBNNN(const Instruction& ins) //BNNN jump to address NNN + m_State.registers[0]
+										   //		with the jump quirk BXNN jumps to XNN + m_State.registers[X]
+{
+	m_State.memoryPosition = ins.nnn + m_State.registers[(QUIRKS & QUIRK_JUMP) ? ins.x : 0];
+}
+
+void Chip8::OpCXNN(const Instruction& ins) //CXNN Sets m_State.registers[X] to a random byte AND NN
+{
+	m_State.registers[ins.x] = NextRandom() & ins.nn;
+	m_State.memoryPosition += 2;
+}
+
+template<unsigned int QUIRKS>
+void Chip8::OpDXYN(const Instruction& ins) // DXYN: Draws a sprite at (VX, VY), width = 8 pixels and a height = N pixels.
+										   // Each row of 8 pixels is read as bit-coded starting from memory location I;
+										   // RegisterIndex value doesn't change after the execution of this instruction.
+										   // m_State.registers[0xF] is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn,
+										   // and to 0 if that doesn't happen
+{
+	U16 height = ins.n; //height of the sprite
+	U16 xPos = GetRegisterData(ins.x); //start position X
+	U16 yPos = GetRegisterData(ins.y); //start position Y
+
+	DrawPixel<(QUIRKS & QUIRK_WRAP) != 0>(xPos, yPos, height);
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpEX9E(const Instruction& ins) //EX9E Skips the next instruction if the key stored in m_State.registers[X] is pressed
+{
+	U8 registerData = GetRegisterData(ins.x);
+	if (IsKeyPressed(registerData)) //pressed
+	{
+		m_State.memoryPosition += GetSkipLength();
+	}
+	else
+	{
+		m_State.memoryPosition += 2;
+	}
+}
+
+void Chip8::OpEXA1(const Instruction& ins) //EXA1 Skips the next instruction if the key stored in m_State.registers[X] isn`t pressed
+{
+	U8 registerData = GetRegisterData(ins.x);
+	if (!IsKeyPressed(registerData)) //not pressed
+	{
+		m_State.memoryPosition += GetSkipLength();
+	}
+	else
+	{
+		m_State.memoryPosition += 2;
+	}
+}
+
+void Chip8::OpFX07(const Instruction& ins) //FX07 set m_Registers[X] to the value of the delay timer
+{
+	m_State.registers[ins.x] = m_State.delayTimer;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX0A(const Instruction& ins) //FX0A a key press is awaited and then stored in m_Registers[X]
+{
+	bool bKeyPressed = false;
+
+	//look for a pressed key and store it in the register
+	for (U8 i = 0; i < 16; i++)
+	{
+		if (m_State.keys[i] != 0)
+		{
+			m_State.registers[ins.x] = i;
+			bKeyPressed = true;
+		}
+	}
+
+	//if the key is not pressed try again, keeps the game loop going
+	if (bKeyPressed)
+	{
+		m_State.memoryPosition += 2;
+	}
+}
+
+void Chip8::OpFX15(const Instruction& ins) //FX15 set the delay timer to m_Registers[X]
+{
+	m_State.delayTimer = GetRegisterData(ins.x);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX18(const Instruction& ins) //FX18 set the sound timer to m_Registers[X]
+{
+	m_State.soundTimer = GetRegisterData(ins.x);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX1E(const Instruction& ins) //FX1E Adds m_Registers[X] to RegisterIndex
+{
+	U8 val = GetRegisterData(ins.x);
+	m_State.registerIndex = (m_State.registerIndex + val) & GetIndexMask();
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX29(const Instruction& ins) //FX29 Sets m_State.registerIndex to the location of the sprite for the character m_State.registers[X]
+										   //		Characters 0-F are represented by a 4x5 font
+{
+	m_State.registerIndex = GetRegisterData(ins.x) * 5;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX33(const Instruction& ins) //FX33 store the Binary Coded decimal representation of m_State.registers[X] with the most significant of three digits at the address in m_State.registerIndex
+										   //		the middle digit at _RegisterIndex +1 and the least significant digit at m_State.registerIndex +2. In other words take the decimal representation
+										   //		of m_Registers[X] place the hundreds digit in memory at the location in m_State.registerIndex the tens digit in m-_RegisterIndex +1
+										   //		and the ones digit in m_State.registerIndex +2
+{
+	U8 value = GetRegisterData(ins.x);
+
+	U8 mostSignificant = value / 100;
+	U8 middle = (value / 10) % 10;
+	U8 least = (value % 100) % 10;
+
+	m_Memory[m_State.registerIndex & m_MemoryMask] = mostSignificant;
+	m_Memory[(m_State.registerIndex + 1) & m_MemoryMask] = middle;
+	m_Memory[(m_State.registerIndex + 2) & m_MemoryMask] = least;
+	InvalidateCode(m_State.registerIndex, 3);
+
+	m_State.memoryPosition += 2;
+}
+
+template<unsigned int QUIRKS>
+void Chip8::OpFX55(const Instruction& ins) //FX55 store m_Registers[0] to m_Registers[X] in memory starting at address m_State.registerIndex
+										   //		the value of the I register will be incremented by X + 1. This is due to the changing of addresses by the interpreter.
+{
+	for (int i = 0; i <= ins.x; i++)
+	{
+		m_Memory[(m_State.registerIndex + i) & m_MemoryMask] = GetRegisterData(i);
+	}
+	InvalidateCode(m_State.registerIndex, ins.x + 1);
+
+	if (!(QUIRKS & QUIRK_LOAD_STORE))
+	{
+		m_State.registerIndex = (m_State.registerIndex + ins.x + 1) & GetIndexMask();
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+template<unsigned int QUIRKS>
+void Chip8::OpFX65(const Instruction& ins) //FX65 fills m_Registers[0] to m_Registers[X] with values in memory starting at address m_State.registerIndex
+										   //		the value of the I register will be incremented by X + 1. This is due to the changing of addresses by the interpreter.
+{
+	for (int i = 0; i <= ins.x; i++)
+	{
+		m_State.registers[i] = m_Memory[(m_State.registerIndex + i) & m_MemoryMask];
+	}
+
+	if (!(QUIRKS & QUIRK_LOAD_STORE))
+	{
+		m_State.registerIndex = (m_State.registerIndex + ins.x + 1) & GetIndexMask();
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+//SuperChip
+void Chip8::Op00CN(const Instruction& ins) //00CN scroll the screen down by N rows
+{
+	ScrollDown(ins.n);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op00FB(const Instruction&) //00FB scroll the screen right by 4 pixels
+{
+	ScrollRight(4);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op00FC(const Instruction&) //00FC scroll the screen left by 4 pixels
+{
+	ScrollLeft(4);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op00FD(const Instruction&) //00FD exit the interpreter
+{
+	//the memory position doesn't change, the game stops here
+}
+
+void Chip8::Op00FE(const Instruction&) //00FE switch to the 64x32 lores screen
+{
+	SetResolution(false);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op00FF(const Instruction&) //00FF switch to the 128x64 hires screen
+{
+	SetResolution(true);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX30(const Instruction& ins) //FX30 Sets m_State.registerIndex to the 8x10 sprite of the digit m_State.registers[X]
+{
+	m_State.registerIndex = BIG_FONT_ADDRESS + (GetRegisterData(ins.x) & 0xF) * 10;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX75(const Instruction& ins) //FX75 store m_State.registers[0] to m_State.registers[X] in the user flags
+{
+	for (int i = 0; i <= ins.x; i++)
+	{
+		m_State.userFlags[i] = GetRegisterData(i);
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX85(const Instruction& ins) //FX85 fill m_State.registers[0] to m_State.registers[X] from the user flags
+{
+	for (int i = 0; i <= ins.x; i++)
+	{
+		m_State.registers[i] = m_State.userFlags[i];
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+//XO-CHIP
+void Chip8::Op00DN(const Instruction& ins) //00DN scroll the screen up by N rows
+{
+	ScrollUp(ins.n);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op5XY2(const Instruction& ins) //5XY2 store m_State.registers[X] to m_State.registers[Y] in memory starting at m_State.registerIndex
+										   //		the registers are stored in reverse order when X > Y, m_State.registerIndex doesn't change
+{
+	int step = (ins.x <= ins.y) ? 1 : -1;
+	int count = (ins.x <= ins.y) ? ins.y - ins.x + 1 : ins.x - ins.y + 1;
+
+	for (int i = 0; i < count; i++)
+	{
+		m_Memory[(m_State.registerIndex + i) & m_MemoryMask] = GetRegisterData(ins.x + i * step);
+	}
+	InvalidateCode(m_State.registerIndex, count);
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op5XY3(const Instruction& ins) //5XY3 fill m_State.registers[X] to m_State.registers[Y] from memory starting at m_State.registerIndex
+										   //		in reverse order when X > Y, m_State.registerIndex doesn't change
+{
+	int step = (ins.x <= ins.y) ? 1 : -1;
+	int count = (ins.x <= ins.y) ? ins.y - ins.x + 1 : ins.x - ins.y + 1;
+
+	for (int i = 0; i < count; i++)
+	{
+		m_State.registers[ins.x + i * step] = m_Memory[(m_State.registerIndex + i) & m_MemoryMask];
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpF000(const Instruction&) //F000 NNNN set m_State.registerIndex to the 16 bit address NNNN that follows the opcode
+{
+	m_State.registerIndex = ReadWord(m_State.memoryPosition + 2);
+	m_State.memoryPosition += 4;
+}
+
+void Chip8::OpFN01(const Instruction& ins) //FN01 select the planes N that draw, clear and scroll
+{
+	m_State.planes = ins.x & ((1 << PLANES) - 1);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpF002(const Instruction&) //F002 load the 16 byte audio pattern from m_State.registerIndex
+{
+	for (int i = 0; i < 16; i++)
+	{
+		m_State.audioPattern[i] = m_Memory[(m_State.registerIndex + i) & m_MemoryMask];
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::OpFX3A(const Instruction& ins) //FX3A set the pitch of the audio pattern to m_State.registers[X]
+{
+	m_State.pitch = GetRegisterData(ins.x);
+	m_State.memoryPosition += 2;
+}
+
+//MegaChip
+//The MegaChip opcodes are 0NNN machine code calls on the other machines, those keep the loose match on the last nibble.
+//Returns false in MODE_MEGACHIP
+bool Chip8::RunMachineCode(const Instruction& ins)
+{
+	if (m_Mode == MODE_MEGACHIP)
+	{
+		return false;
+	}
+
+	switch (ins.n)
+	{
+	case 0x0: Op00E0(ins); break;
+	case 0xE: Op00EE(ins); break;
+	default: OpUnknown(ins); break;
+	}
+
+	return true;
+}
+
+void Chip8::Op0010(const Instruction& ins) //0010 switch the MegaChip screen off
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	SetMegaChip(false);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op0011(const Instruction& ins) //0011 switch to the 256x192 MegaChip screen
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	SetMegaChip(true);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op00BN(const Instruction& ins) //00BN scroll the screen up by N rows
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	ScrollUp(ins.n);
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op01NN(const Instruction& ins) //01NN NNNN set m_State.registerIndex to the 24 bit address NN NNNN
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.registerIndex = (static_cast<U32>(ins.nn) << 16) | ReadWord(m_State.memoryPosition + 2);
+	m_State.memoryPosition += 4;
+}
+
+void Chip8::Op02NN(const Instruction& ins) //02NN load NN ARGB colors from m_State.registerIndex to the palette, starting at index 1
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	for (int i = 0; i < ins.nn; i++)
+	{
+		U32 color = 0;
+		for (int b = 0; b < 4; b++)
+		{
+			color = (color << 8) | m_Memory[(m_State.registerIndex + i * 4 + b) & m_MemoryMask];
+		}
+
+		m_State.palette[i + 1] = color;
+	}
+
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op03NN(const Instruction& ins) //03NN set the width of MegaChip sprites, 0 is 256
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.spriteWidth = ins.nn;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op04NN(const Instruction& ins) //04NN set the height of MegaChip sprites, 0 is 256
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.spriteHeight = ins.nn;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op05NN(const Instruction& ins) //05NN set the alpha the screen is shown with
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.screenAlpha = ins.nn;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op060N(const Instruction& ins) //060N play the digitised sound at m_State.registerIndex, N is 0 to loop it
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.sampleAddress = m_State.registerIndex;
+	m_State.bSampleLoop = ins.n == 0;
+	m_State.bSamplePlaying = true;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op0700(const Instruction& ins) //0700 stop the digitised sound
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.bSamplePlaying = false;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op080N(const Instruction& ins) //080N set how sprites are blended with the screen
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.blendMode = (ins.n <= BLEND_MULTIPLY) ? static_cast<Blend>(ins.n) : BLEND_NORMAL;
+	m_State.memoryPosition += 2;
+}
+
+void Chip8::Op09NN(const Instruction& ins) //09NN set the palette index that sets VF when a sprite covers it
+{
+	if (RunMachineCode(ins))
+	{
+		return;
+	}
+
+	m_State.collisionColor = ins.nn;
+	m_State.memoryPosition += 2;
+}
+
+//Superinstructions
+template<unsigned int QUIRKS>
+void Chip8::OpANNN_DXYN(const Instruction& ins) //ANNN; DXYN set m_State.registerIndex and draw the sprite
+{
+	m_State.registerIndex = ins.nnn;
+	DrawPixel<(QUIRKS & QUIRK_WRAP) != 0>(GetRegisterData(ins.x), GetRegisterData(ins.y), ins.n);
+
+	m_State.memoryPosition += 4;
+}
+
+void Chip8::Op6XNN_6YNN(const Instruction& ins) //6XNN; 6YNN set two registers
+{
+	m_State.registers[ins.x] = ins.nn;
+	m_State.registers[ins.y] = ins.nn2;
+
+	m_State.memoryPosition += 4;
+}
+
+void Chip8::Op7XNN_3XNN_1NNN(const Instruction& ins) //7XNN; 3XNN; 1NNN add to a counter and jump back until it reaches NN
+{
+	m_State.registers[ins.x] += ins.nn;
+
+	if (m_State.registers[ins.x] == ins.nn2)
+	{
+		//the jump is skipped and not executed
+		m_State.memoryPosition += 6;
+		m_State.cycles--;
+	}
+	else
+	{
+		m_State.memoryPosition = ins.nnn;
+	}
+}
+
+void Chip8::OpFX07_3XNN_1NNN(const Instruction& ins) //FX07; 3XNN; 1NNN read the delay timer and jump back until it reaches NN
+{
+	m_State.registers[ins.x] = m_State.delayTimer;
+
+	if (m_State.registers[ins.x] == ins.nn2)
+	{
+		//the jump is skipped and not executed
+		m_State.memoryPosition += 6;
+		m_State.cycles--;
+	}
+	else
+	{
+		m_State.memoryPosition = ins.nnn;
+	}
+}
+
+#pragma endregion
+
+//Runs one frame, the number of opcodes depends on the speed
+void Chip8::Run()
+{
+	//Reset drawing and sound flags
+	m_bShouldDraw = false;
+	m_bShouldBeep = false;
+
+	Step(m_RunSpeed);
+}
+
+void Chip8::RunFrames(int frames)
+{
+	for (int i = 0; i < frames; i++)
+	{
+		Run();
+	}
+}
+
+void Chip8::Step(int count)
+{
+	//make sure a game is loaded in memory
+	if (!m_bGameLoaded || count <= 0)
+	{
+		return;
+	}
+
+	//the timers tick at 60 Hz, a frame of m_RunSpeed opcodes runs between two ticks.
+	//The backends run the opcodes up to the next tick without checking the timers.
+	//Pause sets m_RunSpeed to 0, stepping while paused keeps the frame length from before the pause
+	int frameLength = (m_RunSpeed > 0) ? m_RunSpeed : m_RunSpeedBeforePause;
+	if (frameLength < 1)
+	{
+		frameLength = 1;
+	}
+
+	U64 end = m_State.cycles + count;
+	while (m_State.cycles < end)
+	{
+		U64 nextTick = m_State.timerCycle + frameLength;
+		if (m_State.cycles < nextTick)
+		{
+			RunBackend(static_cast<int>((end < nextTick ? end : nextTick) - m_State.cycles));
+		}
+
+		if (m_State.cycles >= nextTick)
+		{
+			m_State.timerCycle = m_State.cycles;
+			UpdateTimers();
+		}
+	}
+}
+
+//Runs count opcodes on the selected backend
+void Chip8::RunBackend(int count)
+{
+	if (m_Backend == BACKEND_THREADED)
+	{
+		(this->*m_pRunThreaded)(count);
+		return;
+	}
+
+	if (m_Backend == BACKEND_JIT)
+	{
+		RunJit(count);
+		return;
+	}
+
+	if (m_Backend == BACKEND_NATIVE)
+	{
+		RunNative(count);
+		return;
+	}
+
+	//a superinstruction counts as every opcode it executed
+	U64 end = m_State.cycles + count;
+	while (m_State.cycles < end)
+	{
+		const Instruction& ins = FetchInstruction(static_cast<int>(end - m_State.cycles));
+
+		m_State.cycles += ins.length;
+		(this->*m_pHandlers[ins.op])(ins);
+	}
+}
+
+//Direct threaded interpreter, runs count opcodes.
+//Every handler ends with its own indirect jump to the next handler, so the host branch predictor
+//learns the opcode sequences of the game instead of sharing a single dispatch branch.
+template<unsigned int QUIRKS>
+void Chip8::RunThreaded(int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	//a superinstruction counts as every opcode it executed
+	U64 end = m_State.cycles + count;
+
+	const Instruction* ins = &FetchInstruction(count);
+	m_State.cycles += ins->length;
+
+#if defined(__GNUC__)
+	//address of every handler label, indexed by OpcodeId
+	static void* const labels[OP_COUNT] =
+	{
+		&&label_OP_UNKNOWN,
+		&&label_OP_00E0, &&label_OP_00EE, &&label_OP_1NNN, &&label_OP_2NNN, &&label_OP_3XNN, &&label_OP_4XNN, &&label_OP_5XY0, &&label_OP_6XNN, &&label_OP_7XNN,
+		&&label_OP_8XY0, &&label_OP_8XY1, &&label_OP_8XY2, &&label_OP_8XY3, &&label_OP_8XY4, &&label_OP_8XY5, &&label_OP_8XY6, &&label_OP_8XY7, &&label_OP_8XYE,
+		&&label_OP_9XY0, &&label_OP_ANNN, &&label_OP_BNNN, &&label_OP_CXNN, &&label_OP_DXYN, &&label_OP_EX9E, &&label_OP_EXA1,
+		&&label_OP_FX07, &&label_OP_FX0A, &&label_OP_FX15, &&label_OP_FX18, &&label_OP_FX1E, &&label_OP_FX29, &&label_OP_FX33, &&label_OP_FX55, &&label_OP_FX65,
+		&&label_OP_00CN, &&label_OP_00FB, &&label_OP_00FC, &&label_OP_00FD, &&label_OP_00FE, &&label_OP_00FF, &&label_OP_FX30, &&label_OP_FX75, &&label_OP_FX85,
+		&&label_OP_00DN, &&label_OP_5XY2, &&label_OP_5XY3, &&label_OP_F000, &&label_OP_FN01, &&label_OP_F002, &&label_OP_FX3A,
+		&&label_OP_0010, &&label_OP_0011, &&label_OP_00BN, &&label_OP_01NN, &&label_OP_02NN, &&label_OP_03NN, &&label_OP_04NN, &&label_OP_05NN, &&label_OP_060N, &&label_OP_0700, &&label_OP_080N, &&label_OP_09NN,
+		&&label_OP_ANNN_DXYN, &&label_OP_6XNN_6YNN, &&label_OP_7XNN_3XNN_1NNN, &&label_OP_FX07_3XNN_1NNN
+	};
+
+	#define THREADED_NEXT() \
+		if (m_State.cycles >= end) return; \
+		ins = &FetchInstruction(static_cast<int>(end - m_State.cycles)); \
+		m_State.cycles += ins->length; \
+		goto *labels[ins->op]
+	#define THREADED_HANDLER(id, handler) label_##id: handler(*ins); THREADED_NEXT();
+
+	goto *labels[ins->op];
+#else
+	//MSVC has no label addresses, fall back to a switch that every handler jumps back to
+	#define THREADED_NEXT() \
+		if (m_State.cycles >= end) return; \
+		ins = &FetchInstruction(static_cast<int>(end - m_State.cycles)); \
+		m_State.cycles += ins->length; \
+		goto dispatch
+	#define THREADED_HANDLER(id, handler) case id: handler(*ins); THREADED_NEXT();
+
+dispatch:
+	switch (ins->op)
+	{
+#endif
+
+	THREADED_HANDLER(OP_UNKNOWN, OpUnknown)
+	THREADED_HANDLER(OP_00E0, Op00E0)
+	THREADED_HANDLER(OP_00EE, Op00EE)
+	THREADED_HANDLER(OP_1NNN, Op1NNN)
+	THREADED_HANDLER(OP_2NNN, Op2NNN)
+	THREADED_HANDLER(OP_3XNN, Op3XNN)
+	THREADED_HANDLER(OP_4XNN, Op4XNN)
+	THREADED_HANDLER(OP_5XY0, Op5XY0)
+	THREADED_HANDLER(OP_6XNN, Op6XNN)
+	THREADED_HANDLER(OP_7XNN, Op7XNN)
+	THREADED_HANDLER(OP_8XY0, Op8XY0)
+	THREADED_HANDLER(OP_8XY1, Op8XY1<QUIRKS>)
+	THREADED_HANDLER(OP_8XY2, Op8XY2<QUIRKS>)
+	THREADED_HANDLER(OP_8XY3, Op8XY3<QUIRKS>)
+	THREADED_HANDLER(OP_8XY4, Op8XY4)
+	THREADED_HANDLER(OP_8XY5, Op8XY5)
+	THREADED_HANDLER(OP_8XY6, Op8XY6<QUIRKS>)
+	THREADED_HANDLER(OP_8XY7, Op8XY7)
+	THREADED_HANDLER(OP_8XYE, Op8XYE<QUIRKS>)
+	THREADED_HANDLER(OP_9XY0, Op9XY0)
+	THREADED_HANDLER(OP_ANNN, OpANNN)
+	THREADED_HANDLER(OP_BNNN, OpBNNN<QUIRKS>)
+	THREADED_HANDLER(OP_CXNN, OpCXNN)
+	THREADED_HANDLER(OP_DXYN, OpDXYN<QUIRKS>)
+	THREADED_HANDLER(OP_EX9E, OpEX9E)
+	THREADED_HANDLER(OP_EXA1, OpEXA1)
+	THREADED_HANDLER(OP_FX07, OpFX07)
+	THREADED_HANDLER(OP_FX0A, OpFX0A)
+	THREADED_HANDLER(OP_FX15, OpFX15)
+	THREADED_HANDLER(OP_FX18, OpFX18)
+	THREADED_HANDLER(OP_FX1E, OpFX1E)
+	THREADED_HANDLER(OP_FX29, OpFX29)
+	THREADED_HANDLER(OP_FX33, OpFX33)
+	THREADED_HANDLER(OP_FX55, OpFX55<QUIRKS>)
+	THREADED_HANDLER(OP_FX65, OpFX65<QUIRKS>)
+	THREADED_HANDLER(OP_00CN, Op00CN)
+	THREADED_HANDLER(OP_00FB, Op00FB)
+	THREADED_HANDLER(OP_00FC, Op00FC)
+	THREADED_HANDLER(OP_00FD, Op00FD)
+	THREADED_HANDLER(OP_00FE, Op00FE)
+	THREADED_HANDLER(OP_00FF, Op00FF)
+	THREADED_HANDLER(OP_FX30, OpFX30)
+	THREADED_HANDLER(OP_FX75, OpFX75)
+	THREADED_HANDLER(OP_FX85, OpFX85)
+	THREADED_HANDLER(OP_00DN, Op00DN)
+	THREADED_HANDLER(OP_5XY2, Op5XY2)
+	THREADED_HANDLER(OP_5XY3, Op5XY3)
+	THREADED_HANDLER(OP_F000, OpF000)
+	THREADED_HANDLER(OP_FN01, OpFN01)
+	THREADED_HANDLER(OP_F002, OpF002)
+	THREADED_HANDLER(OP_FX3A, OpFX3A)
+	THREADED_HANDLER(OP_0010, Op0010)
+	THREADED_HANDLER(OP_0011, Op0011)
+	THREADED_HANDLER(OP_00BN, Op00BN)
+	THREADED_HANDLER(OP_01NN, Op01NN)
+	THREADED_HANDLER(OP_02NN, Op02NN)
+	THREADED_HANDLER(OP_03NN, Op03NN)
+	THREADED_HANDLER(OP_04NN, Op04NN)
+	THREADED_HANDLER(OP_05NN, Op05NN)
+	THREADED_HANDLER(OP_060N, Op060N)
+	THREADED_HANDLER(OP_0700, Op0700)
+	THREADED_HANDLER(OP_080N, Op080N)
+	THREADED_HANDLER(OP_09NN, Op09NN)
+	THREADED_HANDLER(OP_ANNN_DXYN, OpANNN_DXYN<QUIRKS>)
+	THREADED_HANDLER(OP_6XNN_6YNN, Op6XNN_6YNN)
+	THREADED_HANDLER(OP_7XNN_3XNN_1NNN, Op7XNN_3XNN_1NNN)
+	THREADED_HANDLER(OP_FX07_3XNN_1NNN, OpFX07_3XNN_1NNN)
+
+#if !defined(__GNUC__)
+	}
+#endif
+
+	#undef THREADED_HANDLER
+	#undef THREADED_NEXT
+}
+
+//Runs count opcodes, hot blocks run as x86-64 code
+void Chip8::RunJit(int count)
+{
+	int executed = 0;
+	while (executed < count)
+	{
+		int blockLength = m_pJit->Execute(this, count - executed);
+
+		executed += blockLength;
+		m_State.cycles += blockLength;
+	}
+}
+
+//Runs count opcodes, blocks that were recompiled ahead of time run natively
+void Chip8::RunNative(int count)
+{
+	int executed = 0;
+	while (executed < count)
+	{
+		int blockLength = 1;
+
+		//indirect jumps and overwritten code have no native block and use the interpreter
+		const NativeBlock* block = (m_State.memoryPosition < 4096) ? m_NativeBlocks[m_State.memoryPosition] : nullptr;
+		if (block != nullptr && block->length <= count - executed)
+		{
+			block->function(*this);
+			blockLength = block->length;
+		}
+		else
+		{
+			ExecuteOpcode();
+		}
+
+		executed += blockLength;
+		m_State.cycles += blockLength;
+	}
+}
+
+void Chip8::MapNativeBlocks()
+{
+	for (int i = 0; i < 4096; ++i)
+	{
+		m_NativeBlocks[i] = nullptr;
+		m_NativeCode[i] = false;
+	}
+	m_bNativeBlocks = false;
+
+	//the blocks only apply to the rom they were generated from.
+	//The Recompiler translates 8XY1-8XY3 and 8XY6/8XYE without the quirks that change them, and skips of 2 bytes
+	if (m_pNativeRom == nullptr || m_pNativeRom->hash != m_GameHash || (m_Quirks & (QUIRK_SHIFT | QUIRK_VF_RESET)) || m_Mode == MODE_XOCHIP || m_Mode == MODE_MEGACHIP)
+	{
+		return;
+	}
+
+	m_bNativeBlocks = true;
+	for (int i = 0; i < m_pNativeRom->count; ++i)
+	{
+		const NativeBlock& block = m_pNativeRom->blocks[i];
+		m_NativeBlocks[block.address & 0xFFF] = &block;
+
+		for (int j = 0; j < block.length * 2; ++j)
+		{
+			m_NativeCode[(block.address + j) & 0xFFF] = true;
+		}
+	}
+}
+
+void Chip8::InvalidateNativeBlocks(int address, int length)
+{
+	if (m_pNativeRom == nullptr)
+	{
+		return;
+	}
+
+	for (int i = address; i < address + length; ++i)
+	{
+		//native blocks only cover the first 4 KB
+		int written = i & m_MemoryMask;
+		if (written >= 4096 || !m_NativeCode[written])
+		{
+			continue;
+		}
+
+		//remove every block that contains the written byte, blocks are at most 255 opcodes long
+		for (int start = written - 510; start <= written; ++start)
+		{
+			const NativeBlock* block = (start >= 0) ? m_NativeBlocks[start] : nullptr;
+			if (block != nullptr && start + block->length * 2 > written)
+			{
+				m_NativeBlocks[start] = nullptr;
+			}
+		}
+	}
+}
+
+void Chip8::UpdateTimers()
+{
+	//update Timer
+	if (m_State.delayTimer > 0)
+	{
+		m_State.delayTimer--;
+	}
+	//update sound timer
+	if (m_State.soundTimer > 0)
+	{
+		//the frontend plays the system beep
+		if (m_State.soundTimer == 1)
+		{
+			m_bShouldBeep = true;
+		}
+
+		m_State.soundTimer--;
+	}
+}
+
+//Picks the specialization of the current quirks, used by code outside the opcode handlers
+void Chip8::DrawPixel(U16 x, U16 y, U16 height)
+{
+	if (m_Quirks & QUIRK_WRAP)
+	{
+		DrawPixel<true>(x, y, height);
+	}
+	else
+	{
+		DrawPixel<false>(x, y, height);
+	}
+}
+
+//Draws a sprite of 8 pixels wide, or 16x16 for a height of 0 outside of MODE_CHIP8.
+//All rows of the sprite are drawn at once by DrawSpriteRows
+template<bool WRAP>
+void Chip8::DrawPixel(U16 x, U16 y, U16 height)
+{
+	if (m_State.bMegaChip)
+	{
+		DrawMegaSprite(x, y, height);
+		return;
+	}
+
+	m_State.registers[0xF] = 0;
+
+	int width = GetWidth();
+	int screenHeight = GetHeight();
+
+	//without wrapping a sprite that starts right of or below the screen isn't drawn
+	if (!WRAP && (x >= width || y >= screenHeight))
+	{
+		return;
+	}
+
+	bool bWide = height == 0 && m_Mode != MODE_CHIP8;
+	if (bWide)
+	{
+		height = 16;
+	}
+
+	int shift = x % width;
+	int row = y % screenHeight;
+
+	//rows below the screen are clipped or continue at the top
+	int count = (height < screenHeight - row) ? height : screenHeight - row;
+	bool bDrawn = false;
+	bool bCollision = false;
+
+	//every selected plane draws its own sprite, the sprite of the next plane follows in memory
+	int address = m_State.registerIndex;
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((m_State.planes & (1 << plane)) == 0)
+		{
+			continue;
+		}
+
+		bCollision |= DrawSpriteRows<WRAP>(m_State.screen[plane], address, row, 0, count, shift, bWide, bDrawn);
+
+		if (WRAP && count < height)
+		{
+			bCollision |= DrawSpriteRows<WRAP>(m_State.screen[plane], address, 0, count, height - count, shift, bWide, bDrawn);
+		}
+
+		address += bWide ? height * 2 : height;
+	}
+
+	//if flipping from set to unset set carry flag to 1
+	m_State.registers[0xF] = bCollision ? 1 : 0;
+
+	//toggle draw flag
+	if (bDrawn)
+	{
+		m_bShouldDraw = true;
+	}
+}
+
+//Picks the blitter for the resolution and the sprite width
+template<bool WRAP>
+bool Chip8::DrawSpriteRows(U64* screen, int address, int row, int first, int count, int shift, bool bWide, bool& bDrawn)
+{
+	if (m_State.bHires)
+	{
+		return bWide ? DrawWords<WRAP, 16, 2>(screen, address, row, first, count, shift, bDrawn) : DrawWords<WRAP, 8, 2>(screen, address, row, first, count, shift, bDrawn);
+	}
+
+	return bWide ? DrawWords<WRAP, 16, 1>(screen, address, row, first, count, shift, bDrawn) : DrawRows<WRAP>(screen, address, row, first, count, shift, bDrawn);
+}
+
+//XORs count lores sprite rows of 8 pixels, starting at sprite row first of the sprite at address, into the screen rows starting at row.
+//Every sprite row is moved to the left of a 64 bit lane and then right to x, pixels that move past the
+//right edge are clipped or rotated back in on the left. Returns true when a set pixel was cleared
+template<bool WRAP>
+bool Chip8::DrawRows(U64* screen, int address, int row, int first, int count, int shift, bool& bDrawn)
+{
+	//gather the sprite rows, the lanes after count stay 0 and leave the screen unchanged
+	alignas(16) U8 sprite[16] = {};
+	GatherSprite(sprite, address + first, count);
+
+	U64* rows = screen + row;
+
+#if defined(CHIP8_BLIT_AVX2)
+	//4 rows per vector, the blitter may touch up to SCREEN_PADDING rows past the screen
+	__m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(sprite));
+
+	//rows with a set sprite pixel change
+	int nonZero = ~_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128())) & 0xFFFF;
+	m_DirtyRows |= static_cast<U64>(nonZero) << row;
+	__m128i right = _mm_cvtsi32_si128(shift);
+	__m128i left = _mm_cvtsi32_si128(WIDTH - shift); //64 when shift is 0, which shifts everything out
+	__m256i collision = _mm256_setzero_si256();
+	__m256i drawn = _mm256_setzero_si256();
+
+	for (int i = 0; i < count; i += 4)
+	{
+		__m256i lanes = _mm256_slli_epi64(_mm256_cvtepu8_epi64(bytes), WIDTH - 8);
+		bytes = _mm_srli_si128(bytes, 4);
+
+		__m256i bits = _mm256_srl_epi64(lanes, right);
+		if (WRAP)
+		{
+			bits = _mm256_or_si256(bits, _mm256_sll_epi64(lanes, left));
+		}
+
+		__m256i* screen = reinterpret_cast<__m256i*>(rows + i);
+		__m256i current = _mm256_loadu_si256(screen);
+		collision = _mm256_or_si256(collision, _mm256_and_si256(current, bits));
+		drawn = _mm256_or_si256(drawn, bits);
+		_mm256_storeu_si256(screen, _mm256_xor_si256(current, bits));
+	}
+
+	bDrawn |= !_mm256_testz_si256(drawn, drawn);
+	return !_mm256_testz_si256(collision, collision);
+#elif defined(CHIP8_BLIT_SSE2)
+	//2 rows per vector, the blitter may touch up to SCREEN_PADDING rows past the screen
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i*>(sprite));
+	__m128i right = _mm_cvtsi32_si128(shift);
+	__m128i left = _mm_cvtsi32_si128(WIDTH - shift); //64 when shift is 0, which shifts everything out
+	__m128i collision = zero;
+
+	//rows with a set sprite pixel change
+	int nonZero = ~_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) & 0xFFFF;
+	m_DirtyRows |= static_cast<U64>(nonZero) << row;
+	__m128i drawn = zero;
+
+	for (int i = 0; i < count; i += 2)
+	{
+		//widen the next 2 bytes to 64 bit lanes
+		__m128i lanes = _mm_unpacklo_epi8(bytes, zero);
+		lanes = _mm_unpacklo_epi16(lanes, zero);
+		lanes = _mm_unpacklo_epi32(lanes, zero);
+		lanes = _mm_slli_epi64(lanes, WIDTH - 8);
+		bytes = _mm_srli_si128(bytes, 2);
+
+		__m128i bits = _mm_srl_epi64(lanes, right);
+		if (WRAP)
+		{
+			bits = _mm_or_si128(bits, _mm_sll_epi64(lanes, left));
+		}
+
+		__m128i* screen = reinterpret_cast<__m128i*>(rows + i);
+		__m128i current = _mm_loadu_si128(screen);
+		collision = _mm_or_si128(collision, _mm_and_si128(current, bits));
+		drawn = _mm_or_si128(drawn, bits);
+		_mm_storeu_si128(screen, _mm_xor_si128(current, bits));
+	}
+
+	bDrawn |= _mm_movemask_epi8(_mm_cmpeq_epi8(drawn, zero)) != 0xFFFF;
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(collision, zero)) != 0xFFFF;
+#else
+	U64 collision = 0;
+	U64 drawn = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		U64 lane = static_cast<U64>(sprite[i]) << (WIDTH - 8);
+		U64 bits = lane >> shift;
+		if (WRAP && shift != 0)
+		{
+			bits |= lane << (WIDTH - shift);
+		}
+
+		collision |= rows[i] & bits;
+		drawn |= bits;
+		rows[i] ^= bits;
+
+		if (bits != 0)
+		{
+			m_DirtyRows |= 1ULL << (row + i);
+		}
+	}
+
+	bDrawn |= drawn != 0;
+	return collision != 0;
+#endif
+}
+
+//XORs count sprite rows of SPRITE_WIDTH pixels into screen rows of ROW_WORDS words, used for hires and 16x16 sprites.
+//A sprite row is at most 16 pixels, so it touches 2 words of a row at most. The sprite row is moved to the left of
+//a 64 bit lane, the part that is shifted out of the lane continues in the next word or wraps to the first one
+template<bool WRAP, int SPRITE_WIDTH, int ROW_WORDS>
+bool Chip8::DrawWords(U64* screen, int address, int row, int first, int count, int shift, bool& bDrawn)
+{
+	const int BYTES = SPRITE_WIDTH / 8;
+	int wordShift = shift & 63;
+
+	//gather the sprite rows, the rows after count stay 0 and leave the screen unchanged
+	alignas(16) U8 sprite[32] = {};
+	GatherSprite(sprite, address + first * BYTES, count * BYTES);
+
+#if defined(CHIP8_BLIT_AVX2) || defined(CHIP8_BLIT_SSE2)
+	//every sprite row as 16 bits with its left pixel in the top bit, 8 pixel rows get a zero low byte.
+	//The values are kept in memory so any group of rows can be widened to 64 bit lanes
+	const __m128i zero = _mm_setzero_si128();
+	__m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(sprite));
+	__m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(sprite + 16));
+	if (SPRITE_WIDTH == 8)
+	{
+		high = _mm_unpackhi_epi8(zero, low);
+		low = _mm_unpacklo_epi8(zero, low);
+	}
+	else
+	{
+		low = _mm_or_si128(_mm_slli_epi16(low, 8), _mm_srli_epi16(low, 8));
+		high = _mm_or_si128(_mm_slli_epi16(high, 8), _mm_srli_epi16(high, 8));
+	}
+
+	alignas(16) U16 values[24] = {}; //the last group of rows may read past count
+	_mm_store_si128(reinterpret_cast<__m128i*>(values), low);
+	_mm_store_si128(reinterpret_cast<__m128i*>(values + 8), high);
+
+	//rows with a set sprite pixel change
+	int nonZero = ~_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(low, zero), _mm_cmpeq_epi16(high, zero))) & 0xFFFF;
+	m_DirtyRows |= static_cast<U64>(nonZero) << row;
+	U64* rows = screen + row * ROW_WORDS;
+#endif
+
+#if defined(CHIP8_BLIT_AVX2)
+	//4 words per vector, 4 lores rows or 2 hires rows. Every word gets the lane shifted right into it and the part
+	//shifted out of the word before it, with one count per word. Counts of 64 shift everything out
+	const int ROWS = 4 / ROW_WORDS;
+	long long spill = 64 - wordShift; //64 when the sprite doesn't cross a word
+	long long wrap = WRAP ? spill : 64;
+	__m256i right, left;
+	if (ROW_WORDS == 1)
+	{
+		right = _mm256_set1_epi64x(wordShift);
+		left = _mm256_set1_epi64x(wrap);
+	}
+	else if (shift < 64)
+	{
+		right = _mm256_setr_epi64x(wordShift, 64, wordShift, 64);
+		left = _mm256_setr_epi64x(64, spill, 64, spill);
+	}
+	else
+	{
+		right = _mm256_setr_epi64x(64, wordShift, 64, wordShift);
+		left = _mm256_setr_epi64x(wrap, 64, wrap, 64);
+	}
+
+	__m256i collision = _mm256_setzero_si256();
+	__m256i drawn = _mm256_setzero_si256();
+
+	for (int i = 0; i < count; i += ROWS)
+	{
+		__m256i lanes = _mm256_cvtepu16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values + i)));
+		if (ROW_WORDS == 2)
+		{
+			lanes = _mm256_permute4x64_epi64(lanes, 0x50); //both words of a row start from the same lane
+		}
+		lanes = _mm256_slli_epi64(lanes, 48);
+
+		__m256i bits = _mm256_or_si256(_mm256_srlv_epi64(lanes, right), _mm256_sllv_epi64(lanes, left));
+
+		__m256i* screen = reinterpret_cast<__m256i*>(rows + i * ROW_WORDS);
+		__m256i current = _mm256_loadu_si256(screen);
+		collision = _mm256_or_si256(collision, _mm256_and_si256(current, bits));
+		drawn = _mm256_or_si256(drawn, bits);
+		_mm256_storeu_si256(screen, _mm256_xor_si256(current, bits));
+	}
+
+	bDrawn |= !_mm256_testz_si256(drawn, drawn);
+	return !_mm256_testz_si256(collision, collision);
+#elif defined(CHIP8_BLIT_SSE2)
+	//2 words per vector, 2 lores rows or 1 hires row. SSE2 shifts both words by the same count, the 2 words of a
+	//hires row are put together from the lane shifted right and the part shifted out of the word
+	__m128i right = _mm_cvtsi32_si128(wordShift);
+	__m128i left = _mm_cvtsi32_si128(64 - wordShift); //64 when shift is 0, which shifts everything out
+	__m128i collision = zero;
+	__m128i drawn = zero;
+
+	for (int i = 0; i < count; i += 2 / ROW_WORDS)
+	{
+		__m128i lanes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(values + i));
+		lanes = _mm_unpacklo_epi32(_mm_unpacklo_epi16(lanes, zero), zero);
+		lanes = _mm_slli_epi64(lanes, 48);
+
+		__m128i shifted = _mm_srl_epi64(lanes, right);
+		__m128i spill = _mm_sll_epi64(lanes, left);
+		__m128i bits;
+		if (ROW_WORDS == 1)
+		{
+			bits = WRAP ? _mm_or_si128(shifted, spill) : shifted;
+		}
+		else if (shift < 64)
+		{
+			bits = _mm_unpacklo_epi64(shifted, spill);
+		}
+		else
+		{
+			bits = _mm_unpacklo_epi64(WRAP ? spill : zero, shifted);
+		}
+
+		__m128i* screen = reinterpret_cast<__m128i*>(rows + i * ROW_WORDS);
+		__m128i current = _mm_loadu_si128(screen);
+		collision = _mm_or_si128(collision, _mm_and_si128(current, bits));
+		drawn = _mm_or_si128(drawn, bits);
+		_mm_storeu_si128(screen, _mm_xor_si128(current, bits));
+	}
+
+	bDrawn |= _mm_movemask_epi8(_mm_cmpeq_epi8(drawn, zero)) != 0xFFFF;
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(collision, zero)) != 0xFFFF;
+#else
+	U64 collision = 0;
+	U64 drawn = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		U64 lane = static_cast<U64>(sprite[i * BYTES]) << 56;
+		if (SPRITE_WIDTH == 16)
+		{
+			lane |= static_cast<U64>(sprite[i * BYTES + 1]) << 48;
+		}
+
+		U64 bits[2];
+		U64 spill = (wordShift != 0) ? lane << (64 - wordShift) : 0; //pixels past the end of the word
+		if (ROW_WORDS == 1)
+		{
+			bits[0] = (lane >> wordShift) | (WRAP ? spill : 0);
+		}
+		else if (shift < 64)
+		{
+			bits[0] = lane >> wordShift;
+			bits[1] = spill;
+		}
+		else
+		{
+			bits[0] = WRAP ? spill : 0;
+			bits[1] = lane >> wordShift;
+		}
+
+		U64* words = screen + (row + i) * ROW_WORDS;
+		U64 changed = 0;
+		for (int w = 0; w < ROW_WORDS; w++)
+		{
+			collision |= words[w] & bits[w];
+			changed |= bits[w];
+			words[w] ^= bits[w];
+		}
+
+		if (changed != 0)
+		{
+			m_DirtyRows |= 1ULL << (row + i);
+		}
+		drawn |= changed;
+	}
+
+	bDrawn |= drawn != 0;
+	return collision != 0;
+#endif
+}
+
+void Chip8::GatherSprite(U8* sprite, int address, int length)
+{
+	address &= m_MemoryMask;
+	if (address + length <= m_MemorySize)
+	{
+		memcpy(sprite, m_Memory + address, length);
+		return;
+	}
+
+	for (int i = 0; i < length; i++)
+	{
+		sprite[i] = m_Memory[(address + i) & m_MemoryMask];
+	}
+}
+
+//Turns the MegaChip screen on or off, both start out empty
+void Chip8::SetMegaChip(bool bMegaChip)
+{
+	m_State.bMegaChip = bMegaChip;
+
+	if (!bMegaChip)
+	{
+		ClearScreen((1 << PLANES) - 1);
+		return;
+	}
+
+	AllocateMegaScreen();
+	memset(m_MegaScreen, 0, MEGA_SIZE * 2);
+	memset(m_MegaColors, 0, MEGA_SIZE * 2 * sizeof(U32));
+	m_State.megaFront = 0;
+
+	m_DirtyRows = ~0ULL;
+	m_bShouldDraw = true;
+}
+
+void Chip8::AllocateMegaScreen()
+{
+	if (m_MegaScreen == nullptr)
+	{
+		m_MegaScreen = new U8[MEGA_SIZE * 2];
+		m_MegaColors = new U32[MEGA_SIZE * 2];
+	}
+}
+
+//Draws a sprite of m_State.spriteWidth x m_State.spriteHeight palette indices to the back buffer, sprites are clipped at the edges.
+//The 1 bit fonts are still drawn as 8 pixel rows, or 16x16 for a height of 0, in palette index 255
+void Chip8::DrawMegaSprite(int x, int y, int height)
+{
+	m_State.registers[0xF] = 0;
+
+	if (x >= MEGA_WIDTH || y >= MEGA_HEIGHT)
+	{
+		return;
+	}
+
+	bool bFont = m_State.registerIndex < BIG_FONT_ADDRESS + 160;
+	int spriteWidth = bFont ? (height == 0 ? 16 : 8) : (m_State.spriteWidth == 0 ? 256 : m_State.spriteWidth);
+	int spriteHeight = bFont ? (height == 0 ? 16 : height) : (m_State.spriteHeight == 0 ? 256 : m_State.spriteHeight);
+
+	int columns = (spriteWidth < MEGA_WIDTH - x) ? spriteWidth : MEGA_WIDTH - x;
+	int rows = (spriteHeight < MEGA_HEIGHT - y) ? spriteHeight : MEGA_HEIGHT - y;
+
+	U8* indices = GetMegaBack() + y * MEGA_WIDTH + x;
+	U32* colors = GetMegaBackColors() + y * MEGA_WIDTH + x;
+	bool bCollision = false;
+	U8 line[MEGA_WIDTH];
+
+	for (int row = 0; row < rows; row++)
+	{
+		const U8* sprite = line;
+		if (bFont)
+		{
+			//expand the bits of the font row to palette indices
+			int address = m_State.registerIndex + row * (spriteWidth / 8);
+			U32 bits = (m_Memory[address & m_MemoryMask] << 8) | m_Memory[(address + 1) & m_MemoryMask];
+			for (int i = 0; i < columns; i++)
+			{
+				line[i] = ((bits >> (15 - i)) & 1) ? 255 : 0;
+			}
+		}
+		else
+		{
+			//rows that run past the end of memory wrap around like every other read
+			int address = (m_State.registerIndex + row * spriteWidth) & m_MemoryMask;
+			if (address + columns <= m_MemorySize)
+			{
+				sprite = m_Memory + address;
+			}
+			else
+			{
+				for (int i = 0; i < columns; i++)
 				{
-					m_Register[x] = i;
-					bKeyPressed = true;
+					line[i] = m_Memory[(address + i) & m_MemoryMask];
 				}
 			}
+		}
+
+		bCollision |= BlitRow(indices + row * MEGA_WIDTH, colors + row * MEGA_WIDTH, sprite, columns);
+	}
+
+	m_State.registers[0xF] = bCollision ? 1 : 0;
+}
+
+//Draws count pixels of a sprite row, palette index 0 is transparent. The indices are copied in vector chunks,
+//the colors are looked up in the palette the sprite is drawn with. Returns true when an opaque pixel covered the collision color
+bool Chip8::BlitRow(U8* indices, U32* colors, const U8* sprite, int count)
+{
+	bool bCollision = false;
+	int i = 0;
+
+#if defined(CHIP8_BLIT_AVX2)
+	//32 pixels per vector
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i collisionColor = _mm256_set1_epi8(static_cast<char>(m_State.collisionColor));
+	__m256i collision = zero;
+
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprite + i));
+		__m256i* screen = reinterpret_cast<__m256i*>(indices + i);
+		__m256i current = _mm256_loadu_si256(screen);
+		__m256i transparent = _mm256_cmpeq_epi8(pixels, zero);
+
+		collision = _mm256_or_si256(collision, _mm256_andnot_si256(transparent, _mm256_cmpeq_epi8(current, collisionColor)));
+		_mm256_storeu_si256(screen, _mm256_blendv_epi8(pixels, current, transparent));
+	}
+
+	bCollision = !_mm256_testz_si256(collision, collision);
+#elif defined(CHIP8_BLIT_SSE2)
+	//16 pixels per vector
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i collisionColor = _mm_set1_epi8(static_cast<char>(m_State.collisionColor));
+	__m128i collision = zero;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprite + i));
+		__m128i* screen = reinterpret_cast<__m128i*>(indices + i);
+		__m128i current = _mm_loadu_si128(screen);
+		__m128i transparent = _mm_cmpeq_epi8(pixels, zero);
+
+		collision = _mm_or_si128(collision, _mm_andnot_si128(transparent, _mm_cmpeq_epi8(current, collisionColor)));
+		_mm_storeu_si128(screen, _mm_or_si128(_mm_and_si128(transparent, current), _mm_andnot_si128(transparent, pixels)));
+	}
+
+	bCollision = _mm_movemask_epi8(collision) != 0;
+#endif
+
+	for (; i < count; i++)
+	{
+		if (sprite[i] != 0)
+		{
+			bCollision |= indices[i] == m_State.collisionColor;
+			indices[i] = sprite[i];
+		}
+	}
+
+	i = 0;
+
+#if defined(CHIP8_BLIT_AVX2)
+	//8 colors per gather, the other blend modes mix every channel
+	if (m_State.blendMode == BLEND_NORMAL)
+	{
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sprite + i)));
+			__m256i color = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_State.palette), index, 4);
+			__m256i* screen = reinterpret_cast<__m256i*>(colors + i);
+
+			_mm256_storeu_si256(screen, _mm256_blendv_epi8(color, _mm256_loadu_si256(screen), _mm256_cmpeq_epi32(index, zero)));
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		if (sprite[i] != 0)
+		{
+			colors[i] = BlendColor(m_State.palette[sprite[i]], colors[i]);
+		}
+	}
+
+	return bCollision;
+}
+
+//Mixes a sprite color with the screen color under it
+U32 Chip8::BlendColor(U32 color, U32 screen)
+{
+	if (m_State.blendMode == BLEND_NORMAL)
+	{
+		return color;
+	}
+
+	U32 result = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		int source = (color >> shift) & 0xFF;
+		int current = (screen >> shift) & 0xFF;
+		int mixed;
+
+		switch (m_State.blendMode)
+		{
+		case BLEND_25: mixed = (source + current * 3) / 4; break;
+		case BLEND_50: mixed = (source + current) / 2; break;
+		case BLEND_75: mixed = (source * 3 + current) / 4; break;
+		case BLEND_ADD: mixed = (source + current < 255) ? source + current : 255; break;
+		default: mixed = source * current / 255; break;
+		}
+
+		result |= static_cast<U32>(mixed) << shift;
+	}
+
+	return result;
+}
+
+//Scrolls the back buffer by x pixels to the right and y rows down, negative values scroll the other way
+void Chip8::ScrollMega(int x, int y)
+{
+	ScrollPixels(GetMegaBack(), x, y);
+	ScrollPixels(GetMegaBackColors(), x, y);
+}
+
+template<typename T>
+void Chip8::ScrollPixels(T* pixels, int x, int y)
+{
+	int columns = MEGA_WIDTH - (x < 0 ? -x : x);
+	if (columns < 0)
+	{
+		columns = 0;
+	}
+
+	//walk against the scroll direction so every source row is read before it is overwritten
+	for (int i = 0; i < MEGA_HEIGHT; i++)
+	{
+		int row = (y > 0) ? MEGA_HEIGHT - 1 - i : i;
+		int source = row - y;
+		T* line = pixels + row * MEGA_WIDTH;
+
+		if (source < 0 || source >= MEGA_HEIGHT)
+		{
+			memset(line, 0, MEGA_WIDTH * sizeof(T));
+			continue;
+		}
+
+		const T* from = pixels + source * MEGA_WIDTH;
+		if (x >= 0)
+		{
+			memmove(line + x, from, columns * sizeof(T));
+			memset(line, 0, (MEGA_WIDTH - columns) * sizeof(T));
+		}
+		else
+		{
+			memmove(line, from - x, columns * sizeof(T));
+			memset(line + columns, 0, (MEGA_WIDTH - columns) * sizeof(T));
+		}
+	}
+}
+
+//Load a binary file in memory
+bool Chip8::LoadGame(const char* filename)
+{
+	//open the file
+	ifstream file(filename, std::ios::binary);
+
+	//check if the file is open
+	if (!file.is_open())
+	{
+		m_RomSize = 0;
+		Initialize();
+		m_bGameLoaded = false;
+		return false;
+	}
 
-			//if the key is not pressed try again, keeps the game loop going
-			if (bKeyPressed)
-			{
-				m_MemoryPosition += 2;
-			}
+	//get file size
+	file.seekg(0, file.end);
+	auto size = static_cast<int>(file.tellg());
+	file.seekg(0, file.beg);
 
-			break;
-		}
+	//read file
+	auto buffer = new char[size];
+	file.read(buffer, size);
+	file.close();
 
-		case 0x001E: //FX1E Adds m_Registers[X] to RegisterIndex
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
+	bool bLoaded = LoadGame(reinterpret_cast<const U8*>(buffer), size);
+	delete[] buffer;
 
-			U8 val = GetRegisterData(x);
-			m_RegisterIndex += val;
-			m_MemoryPosition += 2;
-			break;
-		}
+	return bLoaded;
+}
 
-		case 0x0055: //FX55 store m_Registers[0] to m_Registers[X] in memory starting at address m_RegisterIndex
-					 //		the value of the I register will be incremented by X + 1. This is due to the changing of addresses by the interpreter.
-		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
+//Load a rom that is already in memory
+bool Chip8::LoadGame(const U8* data, int size)
+{
+	//remove previous game data, MegaChip memory is sized for the rom
+	m_RomSize = size;
+	Initialize();
 
-			for (int i = 0; i <= x; i++)
-			{
-				m_Memory[m_RegisterIndex + i] = GetRegisterData(i);
-			}
+	//the rom has to fit after the first 512 bytes
+	if (data == nullptr || size <= 0 || size > m_MemorySize - 512)
+	{
+		m_bGameLoaded = false;
+		return false;
+	}
 
+	//Generate hash code and toggle compatibility flags for specific games
+	unsigned int hash = HashGen::Adler(reinterpret_cast<const char*>(data), size);
+	ToggleCompatibilityFlags(hash);
+	m_GameHash = hash;
 
-			if (!m_bEnableCompatibility)
-			{
-				m_RegisterIndex += x + 1;
-			}
+	//store it in chip8 memory with an offset of 512 bytes
+	for (int i = 0; i < size; ++i)
+	{
+		m_Memory[i + 512] = data[i];
+	}
+	InvalidateCode(512, size);
+	MapNativeBlocks();
 
-			m_MemoryPosition += 2;
-			break;
-		}
+	m_bGameLoaded = true;
+	return true;
+}
+
+//Snapshots are the State, memory and both MegaChip buffers when the MegaChip screen is on
+int Chip8::GetStateSize()
+{
+	static_assert(std::is_trivially_copyable<State>::value, "snapshots copy the state as bytes");
+
+	return sizeof(State) + m_MemorySize + (m_State.bMegaChip ? MEGA_SNAPSHOT_SIZE : 0);
+}
+
+int Chip8::GetMaxStateSize()
+{
+	return sizeof(State) + m_MemorySize + (m_Mode == MODE_MEGACHIP ? MEGA_SNAPSHOT_SIZE : 0);
+}
+
+void Chip8::SaveState(U8* buffer)
+{
+	memcpy(buffer, &m_State, sizeof(State));
+	memcpy(buffer + sizeof(State), m_Memory, m_MemorySize);
+
+	if (m_State.bMegaChip)
+	{
+		U8* mega = buffer + sizeof(State) + m_MemorySize;
+		memcpy(mega, m_MegaScreen, MEGA_SIZE * 2);
+		memcpy(mega + MEGA_SIZE * 2, m_MegaColors, MEGA_SIZE * 2 * sizeof(U32));
+	}
+}
+
+bool Chip8::LoadState(const U8* buffer, int size)
+{
+	//memory is sized by the loaded game, so a snapshot of the same game only differs in the MegaChip buffers
+	if (buffer == nullptr || size < static_cast<int>(sizeof(State)))
+	{
+		return false;
+	}
 
-		case 0x0065: //FX65 fills m_Registers[0] to m_Registers[X] with values in memory starting at address m_RegisterIndex
-					 //		the value of the I register will be incremented by X + 1. This is due to the changing of addresses by the interpreter.
+	//snapshots come from movie files too, every field that indexes memory or a table, or picks a buffer, is checked before anything is copied.
+	//Bools are checked as bytes, reading any other value than 0 or 1 as a bool is undefined
+	const size_t flags[] = { offsetof(State, bHires), offsetof(State, bMegaChip), offsetof(State, bSampleLoop), offsetof(State, bSamplePlaying) };
+	for (size_t flag : flags)
+	{
+		if (buffer[flag] > 1)
 		{
-			U8 x = (m_Opcode & 0x0F00) >> 8;
+			return false;
+		}
+	}
 
-			for (int i = 0; i <= x; i++)
-			{
-				m_Register[i] = m_Memory[m_RegisterIndex + i];
-			}
+	//the blend mode is read through the type under the enum, a value outside of it never ends up in a Blend
+	U16 stackIndex;
+	U32 registerIndex, sampleAddress;
+	U64 cycles, timerCycle;
+	int planes, megaFront, spriteWidth, spriteHeight, screenAlpha;
+	std::underlying_type<Blend>::type blendMode;
+	bool bMegaChip;
+	memcpy(&stackIndex, buffer + offsetof(State, stackIndex), sizeof(stackIndex));
+	memcpy(&registerIndex, buffer + offsetof(State, registerIndex), sizeof(registerIndex));
+	memcpy(&sampleAddress, buffer + offsetof(State, sampleAddress), sizeof(sampleAddress));
+	memcpy(&cycles, buffer + offsetof(State, cycles), sizeof(cycles));
+	memcpy(&timerCycle, buffer + offsetof(State, timerCycle), sizeof(timerCycle));
+	memcpy(&planes, buffer + offsetof(State, planes), sizeof(planes));
+	memcpy(&megaFront, buffer + offsetof(State, megaFront), sizeof(megaFront));
+	memcpy(&spriteWidth, buffer + offsetof(State, spriteWidth), sizeof(spriteWidth));
+	memcpy(&spriteHeight, buffer + offsetof(State, spriteHeight), sizeof(spriteHeight));
+	memcpy(&screenAlpha, buffer + offsetof(State, screenAlpha), sizeof(screenAlpha));
+	memcpy(&blendMode, buffer + offsetof(State, blendMode), sizeof(blendMode));
+	memcpy(&bMegaChip, buffer + offsetof(State, bMegaChip), sizeof(bMegaChip));
+
+	if (stackIndex > 15 || planes < 0 || planes > (1 << PLANES) - 1 || (megaFront != 0 && megaFront != 1))
+	{
+		return false;
+	}
 
-			if (!m_bEnableCompatibility)
-			{
-				m_RegisterIndex += x + 1;
-			}
+	//I and the sample address are never wider than the mode allows, the MegaChip settings are bytes of their opcodes
+	if (registerIndex > GetIndexMask() || sampleAddress > GetIndexMask() || timerCycle > cycles ||
+		spriteWidth < 0 || spriteWidth > 255 || spriteHeight < 0 || spriteHeight > 255 || screenAlpha < 0 || screenAlpha > 255 ||
+		static_cast<unsigned int>(blendMode) > BLEND_MULTIPLY)
+	{
+		return false;
+	}
 
-			m_MemoryPosition += 2;
-			break;
+	if (size != static_cast<int>(sizeof(State)) + m_MemorySize + (bMegaChip ? MEGA_SNAPSHOT_SIZE : 0))
+	{
+		return false;
+	}
+
+	//only copy the blocks that differ, so the decoded and translated code of everything else stays valid
+	const U8* memory = buffer + sizeof(State);
+	const int BLOCK = 64;
+	int first = 0;
+	int last = m_MemorySize;
+
+	while (first < last && memcmp(m_Memory + first, memory + first, BLOCK) == 0)
+	{
+		first += BLOCK;
+	}
+
+	while (last > first && memcmp(m_Memory + last - BLOCK, memory + last - BLOCK, BLOCK) == 0)
+	{
+		last -= BLOCK;
+	}
+
+	if (first < last)
+	{
+		memcpy(m_Memory + first, memory + first, last - first);
+		InvalidateCode(first, last - first);
+	}
+
+	memcpy(&m_State, buffer, sizeof(State));
 
+	if (bMegaChip)
+	{
+		const U8* mega = memory + m_MemorySize;
+		AllocateMegaScreen();
+		memcpy(m_MegaScreen, mega, MEGA_SIZE * 2);
+		memcpy(m_MegaColors, mega + MEGA_SIZE * 2, MEGA_SIZE * 2 * sizeof(U32));
+	}
+
+	m_DirtyRows = ~0ULL;
+	m_bShouldDraw = true;
+	return true;
+}
+
+//Helpers
+#pragma region Helpers
+void Chip8::ClearScreen(int planes)
+{
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((planes & (1 << plane)) == 0)
+		{
+			continue;
 		}
+
+		for (int i = 0; i < SCREEN_WORDS + SCREEN_PADDING; i++)
+			m_State.screen[plane][i] = 0; //clear to black
+	}
+
+	m_DirtyRows = GetScreenRowMask();
+}
+
+//The rows are laid out for the new resolution, so the screen starts empty
+void Chip8::SetResolution(bool bHires)
+{
+	m_State.bHires = bHires;
+	ClearScreen((1 << PLANES) - 1);
+}
+
+//Moves whole rows with a single memmove, the rows at the top are cleared
+void Chip8::ScrollDown(int rows)
+{
+	if (m_State.bMegaChip)
+	{
+		ScrollMega(0, rows);
+		return;
+	}
+
+	int words = GetRowWords();
+	int height = GetHeight();
+	if (rows > height)
+	{
+		rows = height;
+	}
+
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((m_State.planes & (1 << plane)) == 0)
+		{
+			continue;
 		}
-		break;
+
+		U64* screen = m_State.screen[plane];
+		memmove(screen + rows * words, screen, (height - rows) * words * sizeof(U64));
+		memset(screen, 0, rows * words * sizeof(U64));
 	}
+
+	if (rows > 0)
+	{
+		m_DirtyRows = GetScreenRowMask();
 	}
 }
 
-void Chip8::Run()
+//Moves whole rows with a single memmove, the rows at the bottom are cleared
+void Chip8::ScrollUp(int rows)
 {
-	//make sure a game is loaded in memory
-	if (!m_bGameLoaded)
+	if (m_State.bMegaChip)
 	{
-		cerr << "No game is loaded!" << endl;
+		ScrollMega(0, -rows);
 		return;
 	}
 
-	//Reset drawing flag
-	m_bShouldDraw = false;
+	int words = GetRowWords();
+	int height = GetHeight();
+	if (rows > height)
+	{
+		rows = height;
+	}
+
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((m_State.planes & (1 << plane)) == 0)
+		{
+			continue;
+		}
+
+		U64* screen = m_State.screen[plane];
+		memmove(screen, screen + rows * words, (height - rows) * words * sizeof(U64));
+		memset(screen + (height - rows) * words, 0, rows * words * sizeof(U64));
+	}
+
+	if (rows > 0)
+	{
+		m_DirtyRows = GetScreenRowMask();
+	}
+}
 
-	//run multiple opcodes based on speed
-	for (int i = 0; i < m_RunSpeed; i++)
+//Shifts every row as a whole, in hires the pixels of the left word continue in the right one
+void Chip8::ScrollRight(int pixels)
+{
+	if (m_State.bMegaChip)
 	{
-		ExecuteOpcode();
+		ScrollMega(pixels, 0);
+		return;
+	}
 
-		//update Timer
-		if (m_DelayTimer > 0)
+	int height = GetHeight();
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((m_State.planes & (1 << plane)) == 0)
 		{
-			m_DelayTimer--;
+			continue;
 		}
-		//update sound timer
-		if (m_SoundTimer > 0)
+
+		U64* screen = m_State.screen[plane];
+		for (int y = 0; y < height; y++)
 		{
-			//play system beep
-			if (m_SoundTimer == 1)
+			if (m_State.bHires)
+			{
+				U64* row = screen + y * 2;
+				if ((row[0] | row[1]) == 0) continue;
+
+				row[1] = (row[1] >> pixels) | (row[0] << (64 - pixels));
+				row[0] >>= pixels;
+			}
+			else
 			{
-				cout << "\a"; //play system sound
+				if (screen[y] == 0) continue;
+				screen[y] >>= pixels;
 			}
 
-			m_SoundTimer--;
+			//only rows with set pixels change
+			m_DirtyRows |= 1ULL << y;
 		}
 	}
 }
 
-void Chip8::DrawPixel(U16 x, U16 y, U16 height)
+void Chip8::ScrollLeft(int pixels)
 {
-	//width is always 8 pixels
-	const int width = 8;
-
-	m_Register[0xF] = 0;
-	//Access sprite data from memory
-	for (int heightIndex = 0; heightIndex < height; heightIndex++)
+	if (m_State.bMegaChip)
 	{
-		//get spriteData for specific pixel in memory
-		U16 spriteData = m_Memory[m_RegisterIndex + heightIndex];
+		ScrollMega(-pixels, 0);
+		return;
+	}
 
-		for (int widthIndex = 0; widthIndex < width; widthIndex++)
+	int height = GetHeight();
+	for (int plane = 0; plane < PLANES; plane++)
+	{
+		if ((m_State.planes & (1 << plane)) == 0)
 		{
-			int posX = x + widthIndex;
-			int posY = y + heightIndex;
+			continue;
+		}
 
-			//Screen warp
-			if (m_bEnableScreenWrap)
+		U64* screen = m_State.screen[plane];
+		for (int y = 0; y < height; y++)
+		{
+			if (m_State.bHires)
 			{
-				posX = posX%WIDTH;
-				posY = posY%HEIGHT;
+				U64* row = screen + y * 2;
+				if ((row[0] | row[1]) == 0) continue;
+
+				row[0] = (row[0] << pixels) | (row[1] >> (64 - pixels));
+				row[1] <<= pixels;
 			}
-			else if (posX >= WIDTH || posY >= HEIGHT)
+			else
 			{
-				continue;
+				if (screen[y] == 0) continue;
+				screen[y] <<= pixels;
 			}
 
-			//evaluate each bit from left to right
-			//This happens because the AND operand, 0x80, gets shifted right on each loop.
-			U8 filter = (0x80 >> widthIndex);
-			auto data = spriteData & filter;
-
-			//if there is something to draw
-			if (data != 0)
-			{
-				//if flipping from set to unset set carry flag to 1
-				//Collision check
-				int pos = posX + (WIDTH * posY);
-				if (m_Screen[pos] == 1)
-				{
-					m_Register[0xF] = 1;
-				}
-
-				//XOR operation flip from 0000 0000 to 1111 1111 or reverse
-				//this clears the previous drawn pixel in
-				m_Screen[pos] ^= 1;
-
-				//toggle draw flag
-				m_bShouldDraw = true;
-			}
+			//only rows with set pixels change
+			m_DirtyRows |= 1ULL << y;
 		}
 	}
-
 }
 
-//Load a binary file in memory
-void Chip8::LoadGame(const char* filename)
+const U8* Chip8::GetScreenData()
 {
-	//remove previous game data
-	Initialize();
-
-	string name = string(filename);
-	int index = name.find_last_of(('\\')) + 1;
-	name = name.substr(index);
-
-	//open the file
-	ifstream file(filename, std::ios::binary);
-
-	//check if the file is open
-	if (!file.is_open())
+	if (m_State.bMegaChip)
 	{
-		cout << "Chip8::Failed to open file: " << filename << "!\n";
-		m_bGameLoaded = false;
-		return;
+		return GetMegaScreen();
 	}
 
-	//get file size
-	file.seekg(0, file.end);
-	auto size = static_cast<int>(file.tellg());
-	file.seekg(0, file.beg);
-
-	//read file
-	auto buffer = new char[size];
-	file.read(buffer, size);
-	file.close();
-
-	//Generate hash code and toggle compatibility flags for specific games
-	unsigned int hash = HashGen::Adler(buffer, size);
-	cerr << name << ": " << hash << endl;
-	ToggleCompatibilityFlags(hash);
+	int width = GetWidth();
+	int height = GetHeight();
+	int words = GetRowWords();
 
-	//store it in chip8 memory with an offset of 512 bytes
-	for (int i = 0; i < size; ++i)
+	//expand the packed rows to one byte per pixel, with the bit of every plane
+	for (int y = 0; y < height; y++)
 	{
-		m_Memory[i + 512] = buffer[i];
+		for (int x = 0; x < width; x++)
+		{
+			U8 pixel = 0;
+			for (int plane = 0; plane < PLANES; plane++)
+			{
+				const U64* row = m_State.screen[plane] + y * words;
+				pixel |= ((row[x / 64] >> (63 - x % 64)) & 1) << plane;
+			}
+
+			m_ScreenPixels[x + (width * y)] = pixel;
+		}
 	}
 
-	m_bGameLoaded = true;
-	//cout << "Loaded Game: " << filename << "!\n";
+	return m_ScreenPixels;
+}
 
+void Chip8::PressKey(int keyIndex, U8 pressed)
+{
+	m_State.keys[keyIndex] = pressed;
 }
 
-//Helpers
-#pragma region Helpers
-void Chip8::ClearScreen()
+bool Chip8::IsKeyPressed(U8 key)
 {
-	for (int i = 0; i < WIDTH * HEIGHT; i++)
-		m_Screen[i] = 0; //clear to black
+	return m_State.keys[key] != 0;
 }
 
-void Chip8::PressKey(int keyIndex, U8 pressed)
+U64 Chip8::SeedRandom(U64 seed)
 {
-	m_Keys[keyIndex] = pressed;
+	U64 z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+
+	return (z != 0) ? z : 0x9E3779B97F4A7C15ULL;
 }
 
-bool Chip8::IsKeyPressed(U8 key)
+U8 Chip8::NextRandom()
 {
-	return m_Keys[key] != 0;
+	U64 x = m_State.random;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	m_State.random = x;
+
+	//the high bits of the product are the best ones
+	return static_cast<U8>((x * 0x2545F4914F6CDD1DULL) >> 56);
 }
 
 void Chip8::AdjustSpeed(int increment)
@@ -789,6 +2658,55 @@ void Chip8::AdjustSpeed(int increment)
 	}
 }
 
+void Chip8::SetBackend(Backend backend)
+{
+	if (backend == BACKEND_JIT && m_pJit == nullptr)
+	{
+		m_pJit = new Chip8Jit();
+	}
+
+	//the host can't run generated code
+	if (backend == BACKEND_JIT && !m_pJit->IsSupported())
+	{
+		backend = BACKEND_INTERPRETER;
+	}
+
+	m_Backend = backend;
+}
+
+void Chip8::SetNativeRom(const NativeRom* rom)
+{
+	m_pNativeRom = rom;
+	MapNativeBlocks();
+}
+
+void Chip8::SetMode(Mode mode)
+{
+	m_Mode = mode;
+}
+
+void Chip8::SetQuirks(unsigned int quirks)
+{
+	quirks &= QUIRK_COUNT - 1;
+	if (quirks == m_Quirks)
+	{
+		return;
+	}
+
+	//switch to the handlers that were compiled for these quirks
+	m_Quirks = quirks;
+	m_pHandlers = s_QuirkSets[quirks].getHandlers();
+	m_pRunThreaded = s_QuirkSets[quirks].runThreaded;
+
+	//translated code depends on the quirks
+	if (m_pJit != nullptr)
+	{
+		m_pJit->Flush();
+	}
+
+	MapNativeBlocks();
+}
+
 void Chip8::Pause()
 {
 	m_bPaused = !m_bPaused;
@@ -807,44 +2725,120 @@ void Chip8::Pause()
 U8 Chip8::GetRegisterData(int index)
 {
 	PrintRegisterValue(index);
-	return m_Register[index];
+	return m_State.registers[index];
+}
+
+void Chip8::ResizeMemory(int size)
+{
+	if (size == m_MemorySize)
+	{
+		return;
+	}
+
+	delete[] m_Memory;
+	delete[] m_DecodeCache;
+	delete[] m_WrittenPages;
+
+	//the memory position is 16 bit, memory above 64 KB only holds data
+	int codeSize = (size < 0x10000) ? size : 0x10000;
+
+	m_Memory = new U8[size]();
+	m_DecodeCache = new const Instruction*[codeSize]();
+	m_WrittenPages = new U64[((size >> PAGE_SHIFT) + 63) / 64]();
+	m_MemorySize = size;
+	m_MemoryMask = size - 1;
+	m_CodeMask = codeSize - 1;
+}
+
+int Chip8::GetModeMemorySize()
+{
+	if (m_Mode == MODE_XOCHIP)
+	{
+		return 0x10000;
+	}
+
+	if (m_Mode == MODE_MEGACHIP)
+	{
+		//at least the 64 KB the 16 bit opcodes reach, the rom data can take more
+		int size = 0x10000;
+		while (size < 512 + m_RomSize && size < MAX_MEGA_MEMORY)
+		{
+			size <<= 1;
+		}
+
+		return size;
+	}
+
+	return 0x1000;
+}
+
+int Chip8::GetSkipLength()
+{
+	//F000 NNNN and 01NN NNNN are the only opcodes of 4 bytes
+	U16 next = ReadWord(m_State.memoryPosition + 2);
+	if ((m_Mode == MODE_XOCHIP && next == 0xF000) || (m_Mode == MODE_MEGACHIP && (next & 0xFF00) == 0x0100))
+	{
+		return 6;
+	}
+
+	return 4;
 }
 
 void Chip8::PushStack(U16 address)
 {
 	//avoid going out of bounds
-	if (m_StackIndex >= 0 && m_StackIndex < 16)
+	if (m_State.stackIndex >= 0 && m_State.stackIndex < 16)
 	{
 		//Store address
-		m_Stack[m_StackIndex] = address;
+		m_State.stack[m_State.stackIndex] = address;
 
 		//increment stack index
-		m_StackIndex++;
+		m_State.stackIndex++;
 
 		//clamp stack index to 16
-		if (m_StackIndex > 15)
+		if (m_State.stackIndex > 15)
 		{
-			m_StackIndex = 15;
+			m_State.stackIndex = 15;
 		}
 	}
 }
 
 U16 Chip8::PopStack()
 {
-	m_StackIndex--;
-	if (m_StackIndex < 0)
+	//m_State.stackIndex is unsigned, clamp before decrementing so a return without a call stays in bounds
+	if (m_State.stackIndex > 0)
 	{
-		m_StackIndex = 0;
+		m_State.stackIndex--;
 	}
 
-	return m_Stack[m_StackIndex];
+	return m_State.stack[m_State.stackIndex];
 }
 
 void Chip8::ToggleCompatibilityFlags(int hash)
 {
-	m_bEnableScreenWrap = (hash == 1598429529); //Vers Enabled
-	m_bEnableCompatibility = (hash == 348653547); //Connect4 Enabled
+	//SuperChip 1.1, and MegaChip which builds on it, leave I unchanged in FX55/FX65 and jump to XNN + VX.
+	//XO-CHIP shifts VY like the original interpreter and wraps sprites around the screen
+	unsigned int quirks = 0;
+	if (m_Mode == MODE_SUPERCHIP || m_Mode == MODE_MEGACHIP)
+	{
+		quirks = QUIRK_LOAD_STORE | QUIRK_JUMP;
+	}
+	else if (m_Mode == MODE_XOCHIP)
+	{
+		quirks = QUIRK_SHIFT | QUIRK_WRAP;
+	}
+
+	if (hash == 1598429529) //Vers Enabled
+	{
+		quirks |= QUIRK_WRAP;
+	}
+
+	if (hash == 348653547) //Connect4 Enabled
+	{
+		quirks |= QUIRK_LOAD_STORE;
+	}
 
+	SetQuirks(quirks);
 }
 
 #pragma endregion
@@ -861,6 +2855,6 @@ void Chip8::PrintOpcode()
 void Chip8::PrintRegisterValue(int)
 {
 #ifdef LOGREGISTER
-	cerr << m_Register[index] << " ";
+	cerr << m_State.registers[index] << " ";
 #endif
 }
\ No newline at end of file
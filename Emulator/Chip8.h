@@ -2,53 +2,360 @@
 
 typedef unsigned char U8;
 typedef unsigned short U16;
+typedef unsigned int U32;
+typedef unsigned long long U64;
+
+class Chip8Jit;
+class Chip8Native;
+class ForkPool;
 
 class Chip8
 {
+	friend class Chip8Jit;
+	friend class Chip8Native;
+	friend class ForkPool;
+
 public:
 
+	//Execution backends
+	enum Backend
+	{
+		BACKEND_INTERPRETER, //one central dispatch per instruction
+		BACKEND_THREADED, //every handler jumps to the next one directly
+		BACKEND_JIT, //hot blocks are translated to x86-64 code
+		BACKEND_NATIVE //blocks recompiled ahead of time, see SetNativeRom
+	};
+
+	//Machines the core emulates, the SuperChip and XO-CHIP opcodes are decoded in every mode.
+	//The MegaChip opcodes are machine code calls outside of MODE_MEGACHIP.
+	//The mode picks the default quirks of a game, see SetMode
+	enum Mode
+	{
+		MODE_CHIP8,
+		MODE_SUPERCHIP, //128x64 hires screen, scrolling, 16x16 sprites, big font and user flags
+		MODE_XOCHIP, //64 KB of memory, 2 bitplanes, long I loads, register ranges and audio patterns
+		MODE_MEGACHIP //memory sized to the rom, 0011 switches to a 256x192 indexed color screen
+	};
+
+	//How MegaChip sprites mix with the screen, 080N
+	enum Blend
+	{
+		BLEND_NORMAL,
+		BLEND_25, //25% of the sprite color over the screen
+		BLEND_50,
+		BLEND_75,
+		BLEND_ADD,
+		BLEND_MULTIPLY
+	};
+
+	//Behaviour that differs between Chip8 interpreters.
+	//Every combination has its own handlers with the checks compiled out, see SetQuirks
+	enum Quirk
+	{
+		QUIRK_LOAD_STORE = 1 << 0, //FX55/FX65 leave m_State.registerIndex unchanged
+		QUIRK_SHIFT = 1 << 1, //8XY6/8XYE shift m_State.registers[Y] into m_State.registers[X]
+		QUIRK_WRAP = 1 << 2, //sprites wrap around the screen instead of being clipped
+		QUIRK_JUMP = 1 << 3, //BXNN jumps to XNN + m_State.registers[X]
+		QUIRK_VF_RESET = 1 << 4, //8XY1/8XY2/8XY3 reset m_State.registers[0xF]
+		QUIRK_COUNT = 1 << 5 //number of combinations
+	};
+
+	//Blocks of a rom that were recompiled ahead of time by the Recompiler tool
+	typedef void(*NativeFunction)(Chip8& chip8);
+
+	struct NativeBlock
+	{
+		U16 address; //address of the first opcode
+		U8 length; //number of opcodes in the block
+		NativeFunction function;
+	};
+
+	struct NativeRom
+	{
+		unsigned int hash; //hash of the rom the blocks were generated from
+		const NativeBlock* blocks;
+		int count;
+	};
+
 	//Constructor
 	Chip8();
 	~Chip8();
+	Chip8(const Chip8&) = delete;
+	Chip8& operator=(const Chip8&) = delete;
 
 	//Functions
 	void Initialize();
 	void Run();
-	void LoadGame(const char* filename);		
+	void RunFrames(int frames);
+	void Step(int count); //runs count opcodes without touching the draw and sound flags, the timers tick every m_RunSpeed opcodes
+	bool LoadGame(const char* filename);
+	bool LoadGame(const U8* data, int size);
+
+	//Snapshots of everything a game can observe: the machine state, memory and the MegaChip screen when it is on.
+	//A snapshot only fits the game and mode it was taken from
+	int GetStateSize(); //bytes SaveState writes
+	int GetMaxStateSize(); //largest snapshot the loaded game can take, the MegaChip screen adds to it once it is on
+	void SaveState(U8* buffer);
+	bool LoadState(const U8* buffer, int size); //false when the snapshot doesn't fit the loaded game or is corrupt, nothing is changed then
 
 	//INPUT
 	void PressKey(int keyIndex, U8 pressed);
 	void AdjustSpeed(int increment);
 	void Pause();
+	void SetBackend(Backend backend);
+	void SetNativeRom(const NativeRom* rom);
+	void SetQuirks(unsigned int quirks);
+	void SetMode(Mode mode); //applies to the next game that is loaded
+	void SetSeed(U64 seed) { m_Seed = seed; } //seed of the CXNN random numbers, applies to the next game that is loaded
 
 	//Getters
 	bool shouldDraw() { return m_bShouldDraw; }
+	bool shouldBeep() { return m_bShouldBeep; }
+	bool IsGameLoaded() { return m_bGameLoaded; }
+	unsigned int GetGameHash() { return m_GameHash; }
+	U64 GetInstructionCount() { return m_State.cycles; }
 	int GetRunSpeed() { return m_RunSpeed; }
-	bool GetCompatibilityMode()	{ return m_bEnableCompatibility; }
-	const U8* GetScreenData(){	return m_Screen; }
+	Backend GetBackend() { return m_Backend; }
+	bool HasNativeBlocks() { return m_bNativeBlocks; } //the native rom fits the loaded game, its mode and quirks, BACKEND_NATIVE interprets everything otherwise
+	bool GetCompatibilityMode()	{ return (m_Quirks & QUIRK_LOAD_STORE) != 0; }
+	unsigned int GetQuirks() { return m_Quirks; }
+	Mode GetMode() { return m_Mode; }
+	U64 GetSeed() { return m_Seed; } //taken from the clock unless SetSeed was called, the same seed and input replay a game exactly
+	bool IsHires() { return m_State.bHires; }
+	bool IsMegaChip() { return m_State.bMegaChip; } //the MegaChip screen is on, set by 0011
+	int GetWidth() { return m_State.bMegaChip ? MEGA_WIDTH : m_State.bHires ? HIRES_WIDTH : WIDTH; }
+	int GetHeight() { return m_State.bMegaChip ? MEGA_HEIGHT : m_State.bHires ? HIRES_HEIGHT : HEIGHT; }
+	int GetRowWords() { return GetWidth() / 64; } //U64 words per row of GetScreenRows
+	int GetMemorySize() { return m_MemorySize; }
+	const U8* GetScreenData(); //one byte per pixel with the bit of every plane, or the palette index on the MegaChip screen. GetWidth() bytes per row
+	const U64* GetScreenRows(int plane = 0) { return m_State.screen[plane]; } //GetRowWords() words per row, bit 63 of a word is its left pixel
+	const U8* GetAudioPattern() { return m_State.audioPattern; } //XO-CHIP 128 sample pattern, one bit per sample
+	int GetPitch() { return m_State.pitch; } //XO-CHIP pattern playback rate is 4000 * 2 ^ ((pitch - 64) / 48) Hz
+	const U8* GetMegaScreen() { return m_MegaScreen + m_State.megaFront * MEGA_SIZE; } //MEGA_WIDTH palette indices per row, the buffer 00E0 showed last
+	const U32* GetMegaColors() { return m_MegaColors + m_State.megaFront * MEGA_SIZE; } //the same buffer as ARGB, colored with the palette each sprite was drawn with
+	int GetScreenAlpha() { return m_State.screenAlpha; } //MegaChip screen fade, 255 is opaque
+	bool IsSamplePlaying() { return m_State.bSamplePlaying; } //MegaChip 060N digitised sound at GetSampleAddress, 0700 stops it
+	U32 GetSampleAddress() { return m_State.sampleAddress; }
+	bool IsSampleLooping() { return m_State.bSampleLoop; }
+	U64 GetDirtyRows() { return m_DirtyRows; } //bit per screen row that changed since ClearDirtyRows, every bit when the MegaChip screen was updated
+	void ClearDirtyRows() { m_DirtyRows = 0; }
 	
-	const static int WIDTH = 64;
+	const static int WIDTH = 64; //lores resolution
 	const static int HEIGHT = 32;
+	const static int HIRES_WIDTH = 128; //SuperChip hires resolution
+	const static int HIRES_HEIGHT = 64;
+	const static int SCREEN_WORDS = HIRES_WIDTH / 64 * HIRES_HEIGHT; //U64 words the largest screen takes
+	const static int PLANES = 2; //XO-CHIP bitplanes, the other modes only draw to the first one
+	const static int MEGA_WIDTH = 256; //MegaChip resolution
+	const static int MEGA_HEIGHT = 192;
+	const static int MEGA_SIZE = MEGA_WIDTH * MEGA_HEIGHT;
 
 	
 		
 private:
 
+	//Identifies the handler of an instruction, used by the threaded backend
+	enum OpcodeId
+	{
+		OP_UNKNOWN,
+		OP_00E0, OP_00EE, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+		OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+		OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1,
+		OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+
+		//SuperChip
+		OP_00CN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_FX30, OP_FX75, OP_FX85,
+
+		//XO-CHIP
+		OP_00DN, OP_5XY2, OP_5XY3, OP_F000, OP_FN01, OP_F002, OP_FX3A,
+
+		//MegaChip
+		OP_0010, OP_0011, OP_00BN, OP_01NN, OP_02NN, OP_03NN, OP_04NN, OP_05NN, OP_060N, OP_0700, OP_080N, OP_09NN,
+
+		//superinstructions, sequences of opcodes executed by one handler
+		OP_ANNN_DXYN, OP_6XNN_6YNN, OP_7XNN_3XNN_1NNN, OP_FX07_3XNN_1NNN,
+		OP_COUNT
+	};
+
+	//Decoded instruction, the fields are extracted once when the decode table is built
+	struct Instruction;
+	typedef void (Chip8::*OpcodeHandler)(const Instruction& ins);
+
+	struct Instruction
+	{
+		U8 op; //OpcodeId of the handler
+		U16 opcode; //raw opcode
+		U16 nnn; //0x0NNN address
+		U8 x, y; //0x0X00 and 0x00Y0 register index
+		U8 n, nn; //0x000N nibble and 0x00NN byte
+		U8 nn2; //0x00NN byte of the second opcode of a superinstruction
+		U8 length; //number of opcodes, more than 1 for superinstructions
+	};
+
 	//Chip8 helpers
 	void CreateOpcode();
+	const Instruction& FetchInstruction(int maxLength);
 	void ExecuteOpcode();
+	void RunBackend(int count);
+	template<unsigned int QUIRKS> void RunThreaded(int count);
+	void RunJit(int count);
+	void RunNative(int count);
+	void MapNativeBlocks();
+	void InvalidateNativeBlocks(int address, int length);
+	void UpdateTimers();
+
+	//Decode table indexed by the full 16 bit opcode
+	static Instruction Decode(U16 opcode);
+	static bool BuildDecodeTable();
+	static Instruction s_DecodeTable[0x10000];
+	static bool s_bDecodeTableBuilt;
+
+	//Predecoded instruction cache, one slot per memory address, filled on first execution.
+	//Has to be called whenever memory is written so cached and translated code is discarded.
+	void InvalidateCode(int address, int length);
+
+	//Superinstructions are recognized when an address is decoded, they are stored in a pool per instance
+	const Instruction* Fuse(U16 address, const Instruction* ins);
+	const static int MAX_FUSED_LENGTH = 3;
+	const static int MAX_FUSED = 256;
+
+	//Handlers and threaded interpreter specialized for one combination of quirks
+	struct QuirkSet
+	{
+		const OpcodeHandler* (*getHandlers)(); //handler of every OpcodeId
+		void (Chip8::*runThreaded)(int count);
+	};
+
+	template<unsigned int QUIRKS> static const OpcodeHandler* GetHandlers();
+	static const QuirkSet s_QuirkSets[QUIRK_COUNT];
+
+	//Opcode handlers
+	void OpUnknown(const Instruction& ins);
+	void Op00E0(const Instruction& ins);
+	void Op00EE(const Instruction& ins);
+	void Op1NNN(const Instruction& ins);
+	void Op2NNN(const Instruction& ins);
+	void Op3XNN(const Instruction& ins);
+	void Op4XNN(const Instruction& ins);
+	void Op5XY0(const Instruction& ins);
+	void Op6XNN(const Instruction& ins);
+	void Op7XNN(const Instruction& ins);
+	void Op8XY0(const Instruction& ins);
+	template<unsigned int QUIRKS> void Op8XY1(const Instruction& ins);
+	template<unsigned int QUIRKS> void Op8XY2(const Instruction& ins);
+	template<unsigned int QUIRKS> void Op8XY3(const Instruction& ins);
+	void Op8XY4(const Instruction& ins);
+	void Op8XY5(const Instruction& ins);
+	template<unsigned int QUIRKS> void Op8XY6(const Instruction& ins);
+	void Op8XY7(const Instruction& ins);
+	template<unsigned int QUIRKS> void Op8XYE(const Instruction& ins);
+	void Op9XY0(const Instruction& ins);
+	void OpANNN(const Instruction& ins);
+	template<unsigned int QUIRKS> void OpBNNN(const Instruction& ins);
+	void OpCXNN(const Instruction& ins);
+	template<unsigned int QUIRKS> void OpDXYN(const Instruction& ins);
+	void OpEX9E(const Instruction& ins);
+	void OpEXA1(const Instruction& ins);
+	void OpFX07(const Instruction& ins);
+	void OpFX0A(const Instruction& ins);
+	void OpFX15(const Instruction& ins);
+	void OpFX18(const Instruction& ins);
+	void OpFX1E(const Instruction& ins);
+	void OpFX29(const Instruction& ins);
+	void OpFX33(const Instruction& ins);
+	template<unsigned int QUIRKS> void OpFX55(const Instruction& ins);
+	template<unsigned int QUIRKS> void OpFX65(const Instruction& ins);
+
+	//SuperChip handlers
+	void Op00CN(const Instruction& ins);
+	void Op00FB(const Instruction& ins);
+	void Op00FC(const Instruction& ins);
+	void Op00FD(const Instruction& ins);
+	void Op00FE(const Instruction& ins);
+	void Op00FF(const Instruction& ins);
+	void OpFX30(const Instruction& ins);
+	void OpFX75(const Instruction& ins);
+	void OpFX85(const Instruction& ins);
+
+	//XO-CHIP handlers
+	void Op00DN(const Instruction& ins);
+	void Op5XY2(const Instruction& ins);
+	void Op5XY3(const Instruction& ins);
+	void OpF000(const Instruction& ins);
+	void OpFN01(const Instruction& ins);
+	void OpF002(const Instruction& ins);
+	void OpFX3A(const Instruction& ins);
+
+	//MegaChip handlers
+	bool RunMachineCode(const Instruction& ins);
+	void Op0010(const Instruction& ins);
+	void Op0011(const Instruction& ins);
+	void Op00BN(const Instruction& ins);
+	void Op01NN(const Instruction& ins);
+	void Op02NN(const Instruction& ins);
+	void Op03NN(const Instruction& ins);
+	void Op04NN(const Instruction& ins);
+	void Op05NN(const Instruction& ins);
+	void Op060N(const Instruction& ins);
+	void Op0700(const Instruction& ins);
+	void Op080N(const Instruction& ins);
+	void Op09NN(const Instruction& ins);
+
+	//Superinstruction handlers
+	template<unsigned int QUIRKS> void OpANNN_DXYN(const Instruction& ins);
+	void Op6XNN_6YNN(const Instruction& ins);
+	void Op7XNN_3XNN_1NNN(const Instruction& ins);
+	void OpFX07_3XNN_1NNN(const Instruction& ins);
+
+	//Memory helpers
+	void ResizeMemory(int size);
+	int GetModeMemorySize(); //power of 2 the mode and the rom need
+	U32 GetIndexMask() { return (m_Mode == MODE_MEGACHIP) ? 0xFFFFFF : 0xFFFF; } //I is 16 bit, MegaChip widens it to 24 bit
+	U16 ReadWord(int address) { return static_cast<U16>((m_Memory[address & m_MemoryMask] << 8) | m_Memory[(address + 1) & m_MemoryMask]); }
+	int GetSkipLength(); //bytes a taken skip advances, 4 byte opcodes are skipped as a whole
+	const static int MAX_MEGA_MEMORY = 0x1000000; //MegaChip loads 24 bit addresses
+	const static int PAGE_SHIFT = 8; //memory is tracked in 256 byte pages for ForkPool
 
 	void PushStack(U16 address);
 	U16 PopStack();
 	U8 GetRegisterData(int index);
 
-	//Drawing Helpers
-	void ClearScreen();
+	//Drawing Helpers, the screen operations only change the planes selected by m_State.planes
+	void ClearScreen(int planes);
+	void SetResolution(bool bHires);
+	void ScrollDown(int rows);
+	void ScrollUp(int rows);
+	void ScrollRight(int pixels);
+	void ScrollLeft(int pixels);
+	U64 GetScreenRowMask() { return (m_State.bHires || m_State.bMegaChip) ? ~0ULL : (1ULL << HEIGHT) - 1; } //bit of every visible row
 	void DrawPixel(U16 x, U16 y, U16 height);
+	template<bool WRAP> void DrawPixel(U16 x, U16 y, U16 height);
+	template<bool WRAP> bool DrawSpriteRows(U64* screen, int address, int row, int first, int count, int shift, bool bWide, bool& bDrawn);
+	template<bool WRAP> bool DrawRows(U64* screen, int address, int row, int first, int count, int shift, bool& bDrawn);
+	void GatherSprite(U8* sprite, int address, int length); //sprite bytes wrap around the end of memory like every other read
+	template<bool WRAP, int SPRITE_WIDTH, int ROW_WORDS> bool DrawWords(U64* screen, int address, int row, int first, int count, int shift, bool& bDrawn);
+	const static int SCREEN_PADDING = 16; //rows after the screen the sprite blitter may touch
+
+	//MegaChip drawing, sprites and scrolls go to the back buffer and 00E0 shows it
+	void SetMegaChip(bool bMegaChip);
+	void AllocateMegaScreen(); //both buffers, left uninitialized
+	void DrawMegaSprite(int x, int y, int height);
+	bool BlitRow(U8* indices, U32* colors, const U8* sprite, int count);
+	U32 BlendColor(U32 color, U32 screen);
+	void ScrollMega(int x, int y);
+	template<typename T> static void ScrollPixels(T* pixels, int x, int y);
+	U8* GetMegaBack() { return m_MegaScreen + (m_State.megaFront ^ 1) * MEGA_SIZE; }
+	U32* GetMegaBackColors() { return m_MegaColors + (m_State.megaFront ^ 1) * MEGA_SIZE; }
+	const static int BIG_FONT_ADDRESS = 80; //SuperChip 8x10 digits, after the 4x5 font
+	const static int MEGA_SNAPSHOT_SIZE = MEGA_SIZE * 2 * (sizeof(U8) + sizeof(U32)); //both MegaChip buffers
 	
 	//Input helpers
 	bool IsKeyPressed(U8 key);
 
+	//Random helpers, xorshift64* seeded through SplitMix64 so every seed gives a nonzero state
+	static U64 SeedRandom(U64 seed);
+	U8 NextRandom();
+
 	//Debug
 	void PrintOpcode();
 	void PrintRegisterValue(int index);
@@ -58,23 +365,81 @@ private:
 	
 	//Chip8 CPU specifics
 	int m_RunSpeed, m_RunSpeedBeforePause;
+	Mode m_Mode;
+	Backend m_Backend;
+	Chip8Jit* m_pJit; //created when the jit backend is selected
+	const NativeRom* m_pNativeRom;
+	const NativeBlock* m_NativeBlocks[4096]; //native block starting at each address of the loaded game
+	bool m_NativeCode[4096]; //true for addresses that are part of a native block
+	bool m_bNativeBlocks; //m_NativeBlocks holds the blocks of m_pNativeRom
+	unsigned int m_GameHash;
+	unsigned int m_Quirks;
+	U64 m_Seed;
+	const OpcodeHandler* m_pHandlers; //handlers of the current quirks
+	void (Chip8::*m_pRunThreaded)(int count);
 
 	U16 m_Opcode; //Current instruction to interpret
-	U16 m_MemoryPosition; //stores the position in memory starts at 0x200	
-	U8 m_Memory[4096]; //chip8 occupies first 512 bytes of the program
-	U16 m_RegisterIndex; //position in the register	
-	U8 m_Register[16]; //V0 - VF
-	U16 m_StackIndex; //position in the stack
-	U16 m_Stack[16]; //used to store return addresses when subroutines are called
-	U8 m_Keys[16]; //Hexadecimal keyboard from 0 to f
-	U8 m_DelayTimer;
-	U8 m_SoundTimer;
-
-	U8 m_Screen[WIDTH * HEIGHT]; //Chip8 Screen
+	U8* m_Memory; //chip8 occupies first 512 bytes of the program, m_MemorySize bytes for the current mode
+	int m_MemorySize;
+	int m_MemoryMask; //the memory size is a power of 2, addresses wrap around
+	int m_RomSize; //size of the loaded rom, MegaChip memory grows to fit it
+	const Instruction** m_DecodeCache; //decode table entry of the opcode at each address m_State.memoryPosition reaches, nullptr when not decoded yet
+	int m_CodeMask; //m_State.memoryPosition is 16 bit, so the cache never needs more than 64 KB of slots
+	U64* m_WrittenPages; //bit per page of memory written since ForkPool last cleared them
+	Instruction m_FusedPool[MAX_FUSED]; //superinstructions the decode cache points to
+	int m_FusedCount;
+	int m_FreeFused[MAX_FUSED]; //pool slots the decode cache no longer points to, reused before new ones
+	int m_FreeFusedCount;
+
+	//Everything a game can observe apart from memory, in one trivially copyable block so a snapshot is a single copy.
+	//The members next to it are host settings and caches that are rebuilt from it
+	struct State
+	{
+		U16 memoryPosition; //stores the position in memory starts at 0x200
+		U32 registerIndex; //position in the register, MegaChip loads 24 bit addresses
+		U8 registers[16]; //V0 - VF
+		U16 stackIndex; //position in the stack
+		U16 stack[16]; //used to store return addresses when subroutines are called
+		U8 keys[16]; //Hexadecimal keyboard from 0 to f
+		U8 delayTimer;
+		U8 soundTimer;
+		U8 userFlags[16]; //SuperChip RPL flags, FX75/FX85
+		U8 audioPattern[16];
+		U8 pitch;
+		U64 cycles; //number of executed opcodes
+		U64 timerCycle; //cycles at the last 60 Hz timer tick
+		U64 random; //CXNN generator state, never 0
+		int planes; //bit per plane FN01 selected for drawing
+		bool bHires;
+
+		//MegaChip, the screen buffers themselves are too big to live here
+		bool bMegaChip;
+		int megaFront; //buffer that is shown, the other one is drawn to
+		int spriteWidth, spriteHeight; //03NN/04NN, 0 is 256
+		int screenAlpha;
+		Blend blendMode;
+		U8 collisionColor; //09NN, VF is set when a sprite covers a pixel of this color
+		U32 sampleAddress; //060N digitised sound, 8 bit samples after a 6 byte header
+		bool bSampleLoop, bSamplePlaying;
+
+		//The large buffers come last, ForkPool copies everything before them with every fork and shares these in pages.
+		//Chip8 Screen, one bit per pixel and one packed buffer per plane. Rows are GetRowWords() words apart,
+		//so switching the resolution only changes how the same storage is read
+		U64 screen[PLANES][SCREEN_WORDS + SCREEN_PADDING];
+		U32 palette[256]; //MegaChip ARGB, index 0 is transparent
+	};
+
+	State m_State;
+	U8 m_ScreenPixels[HIRES_WIDTH * HIRES_HEIGHT]; //one byte per pixel view of the screen for GetScreenData, bit 0 is plane 0
+	U64 m_DirtyRows; //bit per screen row that changed since the frontend last uploaded it
+
+	//MegaChip Screen, two buffers allocated the first time 0011 runs. The palette indices are kept for collisions,
+	//the colors are resolved when a sprite is drawn because games load a new palette for every sprite
+	U8* m_MegaScreen;
+	U32* m_MegaColors;
 
 	//flags
-	bool m_bGameLoaded, m_bShouldDraw, m_bPaused;
-	bool m_bEnableCompatibility, m_bEnableScreenWrap;
+	bool m_bGameLoaded, m_bShouldDraw, m_bShouldBeep, m_bPaused;
 
 };
 
@@ -0,0 +1,477 @@
+#include "Chip8Jit.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHIP8_JIT_X64
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+//x86-64 register indices
+const int AL = 0;
+const int CL = 1;
+const int DL = 2;
+
+//Constructor
+Chip8Jit::Chip8Jit() :
+	m_RegisterOffset(0),
+	m_IndexOffset(0),
+	m_PositionOffset(0),
+	m_Quirks(0),
+	m_bLongSkips(false),
+	m_MemoryMask(0xFFF),
+	m_IndexMask(0xFFFF),
+	m_pCode(nullptr),
+	m_pCursor(nullptr)
+{
+#ifdef CHIP8_JIT_X64
+	//allocate memory for the generated code, it is never writable and executable at the same time
+#if defined(_WIN32)
+	void* code = VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	{
+		code = nullptr;
+	}
+#endif
+	m_pCode = static_cast<U8*>(code);
+	if (m_pCode != nullptr && !SetWritable(false))
+	{
+		//memory that can't be made executable is of no use
+		FreeCode();
+	}
+#endif
+
+	Flush();
+}
+
+//Destructor
+Chip8Jit::~Chip8Jit()
+{
+	FreeCode();
+}
+
+void Chip8Jit::FreeCode()
+{
+	if (m_pCode == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	VirtualFree(m_pCode, 0, MEM_RELEASE);
+#else
+	munmap(m_pCode, CODE_SIZE);
+#endif
+	m_pCode = nullptr;
+}
+
+bool Chip8Jit::SetWritable(bool bWritable)
+{
+#if defined(_WIN32)
+	DWORD previous;
+	return VirtualProtect(m_pCode, CODE_SIZE, bWritable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous) != 0;
+#else
+	return mprotect(m_pCode, CODE_SIZE, bWritable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) == 0;
+#endif
+}
+
+int Chip8Jit::Execute(Chip8* chip8, int maxInstructions)
+{
+	//code above 4 KB is interpreted
+	if (chip8->m_State.memoryPosition >= 4096)
+	{
+		chip8->ExecuteOpcode();
+		return 1;
+	}
+
+	Block& block = m_Blocks[chip8->m_State.memoryPosition];
+
+	//translate the block once it is hot
+	if (block.function == nullptr && m_pCode != nullptr)
+	{
+		if (block.hits < HOT_THRESHOLD)
+		{
+			block.hits++;
+		}
+		else
+		{
+			Compile(chip8, chip8->m_State.memoryPosition);
+		}
+	}
+
+	//only run the block when it doesn't overshoot the opcodes of this frame
+	if (block.function != nullptr && block.length <= maxInstructions)
+	{
+		block.function(chip8);
+		return block.length;
+	}
+
+	chip8->ExecuteOpcode();
+	return 1;
+}
+
+void Chip8Jit::Invalidate(int address, int length)
+{
+	int start = address - 1;
+	int end = address + length;
+
+	//translated code was overwritten, start over
+	for (int i = start; i < end; ++i)
+	{
+		int written = i & m_MemoryMask;
+		if (written < 4096 && m_CodeMap[written])
+		{
+			Flush();
+			return;
+		}
+	}
+}
+
+void Chip8Jit::Flush()
+{
+	m_pCursor = m_pCode;
+	memset(m_Blocks, 0, sizeof(m_Blocks));
+	memset(m_CodeMap, 0, sizeof(m_CodeMap));
+}
+
+bool Chip8Jit::Compile(Chip8* chip8, U16 address)
+{
+	//start over when the code memory is full
+	if (m_pCursor + MAX_BLOCK_SIZE > m_pCode + CODE_SIZE)
+	{
+		Flush();
+	}
+
+	//the code memory is only writable while a block is emitted
+	if (!SetWritable(true))
+	{
+		return false;
+	}
+
+	//offsets of the state the generated code accesses
+	const U8* base = reinterpret_cast<const U8*>(chip8);
+	m_RegisterOffset = static_cast<int>(reinterpret_cast<const U8*>(chip8->m_State.registers) - base);
+	m_IndexOffset = static_cast<int>(reinterpret_cast<const U8*>(&chip8->m_State.registerIndex) - base);
+	m_PositionOffset = static_cast<int>(reinterpret_cast<const U8*>(&chip8->m_State.memoryPosition) - base);
+
+	//the quirks are resolved while translating, SetQuirks flushes the blocks when they change
+	m_Quirks = chip8->m_Quirks;
+	m_bLongSkips = chip8->m_Mode == Chip8::MODE_XOCHIP || chip8->m_Mode == Chip8::MODE_MEGACHIP;
+	m_MemoryMask = chip8->m_MemoryMask;
+	m_IndexMask = chip8->GetIndexMask();
+
+	U8* start = m_pCursor;
+
+	//prologue: keep the Chip8 pointer in rbx, reserve shadow space and keep the stack 16 byte aligned
+	Emit8(0x53); //push rbx
+	Emit8(0x48); Emit8(0x83); Emit8(0xEC); Emit8(0x20); //sub rsp, 32
+#if defined(_WIN32)
+	Emit8(0x48); Emit8(0x89); Emit8(0xCB); //mov rbx, rcx
+#else
+	Emit8(0x48); Emit8(0x89); Emit8(0xFB); //mov rbx, rdi
+#endif
+
+	int length = 0;
+	bool bPositionStored = false;
+	U16 position = address;
+
+	while (length < MAX_BLOCK_LENGTH && position < 4095)
+	{
+		U16 opcode = static_cast<U16>((chip8->m_Memory[position] << 8) | chip8->m_Memory[position + 1]);
+		const Chip8::Instruction& ins = Chip8::s_DecodeTable[opcode];
+
+		if (EmitNative(ins, position))
+		{
+			bPositionStored = EndsBlock(ins.op);
+		}
+		else
+		{
+			EmitHandlerCall(ins, position);
+			bPositionStored = true;
+		}
+
+		m_CodeMap[position] = true;
+		m_CodeMap[position + 1] = true;
+		position += 2;
+		length++;
+
+		if (EndsBlock(ins.op))
+		{
+			break;
+		}
+	}
+
+	if (length == 0)
+	{
+		m_pCursor = start;
+		SetWritable(false);
+		return false;
+	}
+
+	//continue after the last opcode
+	if (!bPositionStored)
+	{
+		EmitStorePosition(position);
+	}
+
+	//epilogue
+	Emit8(0x48); Emit8(0x83); Emit8(0xC4); Emit8(0x20); //add rsp, 32
+	Emit8(0x5B); //pop rbx
+	Emit8(0xC3); //ret
+
+	if (!SetWritable(false))
+	{
+		//none of the blocks can run while the memory isn't executable
+		Flush();
+		return false;
+	}
+
+	Block& block = m_Blocks[address];
+	block.function = reinterpret_cast<BlockFunction>(start);
+	block.length = static_cast<U8>(length);
+	return true;
+}
+
+bool Chip8Jit::EmitNative(const Chip8::Instruction& ins, U16 address)
+{
+	int vx = m_RegisterOffset + ins.x;
+	int vy = m_RegisterOffset + ins.y;
+	int vf = m_RegisterOffset + 0xF;
+
+	switch (ins.op)
+	{
+	case Chip8::OP_1NNN: //1NNN jump to address NNN
+		EmitStorePosition(ins.nnn);
+		return true;
+
+	case Chip8::OP_3XNN: //3XNN skip next instruction if m_State.registers[X] == NN
+	case Chip8::OP_4XNN: //4XNN skip next instruction if m_State.registers[X] != NN
+	case Chip8::OP_5XY0: //5XY0 skip next instruction if m_State.registers[X] == m_State.registers[Y]
+	case Chip8::OP_9XY0: //9XY0 skip next instruction if m_State.registers[X] != m_State.registers[Y]
+	{
+		if (m_bLongSkips)
+		{
+			return false;
+		}
+
+		if (ins.op == Chip8::OP_3XNN || ins.op == Chip8::OP_4XNN)
+		{
+			EmitMem(0x80, 7, vx); Emit8(ins.nn); //cmp byte [vx], nn
+		}
+		else
+		{
+			EmitMem(0x8A, AL, vx); //mov al, [vx]
+			EmitMem(0x3A, AL, vy); //cmp al, [vy]
+		}
+
+		Emit8(0xBA); Emit32(address + 2); //mov edx, address + 2
+		Emit8(0xB9); Emit32(address + 4); //mov ecx, address + 4
+
+		//cmove / cmovne edx, ecx
+		bool bSkipOnEqual = ins.op == Chip8::OP_3XNN || ins.op == Chip8::OP_5XY0;
+		Emit8(0x0F); Emit8(bSkipOnEqual ? 0x44 : 0x45); Emit8(0xD1);
+
+		Emit8(0x66); EmitMem(0x89, DL, m_PositionOffset); //mov [position], dx
+		return true;
+	}
+
+	case Chip8::OP_6XNN: //6XNN set m_State.registers[X] to NN
+		EmitMem(0xC6, 0, vx); Emit8(ins.nn); //mov byte [vx], nn
+		return true;
+
+	case Chip8::OP_7XNN: //7XNN Adds NN to m_State.registers[X]
+		EmitMem(0x80, 0, vx); Emit8(ins.nn); //add byte [vx], nn
+		return true;
+
+	case Chip8::OP_8XY0: //8XY0 set m_State.registers[X] to m_State.registers[Y]
+		EmitMem(0x8A, AL, vy); //mov al, [vy]
+		EmitMem(0x88, AL, vx); //mov [vx], al
+		return true;
+
+	case Chip8::OP_8XY1: //8XY1 m_State.registers[X] |= m_State.registers[Y]
+	case Chip8::OP_8XY2: //8XY2 m_State.registers[X] &= m_State.registers[Y]
+	case Chip8::OP_8XY3: //8XY3 m_State.registers[X] ^= m_State.registers[Y]
+	{
+		U8 aluOp = (ins.op == Chip8::OP_8XY1) ? 0x0A : (ins.op == Chip8::OP_8XY2) ? 0x22 : 0x32;
+		EmitMem(0x8A, AL, vx); //mov al, [vx]
+		EmitMem(aluOp, AL, vy); //or/and/xor al, [vy]
+		EmitMem(0x88, AL, vx); //mov [vx], al
+
+		if (m_Quirks & Chip8::QUIRK_VF_RESET)
+		{
+			EmitMem(0xC6, 0, vf); Emit8(0); //mov byte [vf], 0
+		}
+		return true;
+	}
+
+	case Chip8::OP_8XY4: //8XY4 m_State.registers[X] += m_State.registers[Y], the carry flag is written before the add like the interpreter
+		EmitMem(0x8A, AL, vx); //mov al, [vx]
+		EmitMem(0x8A, CL, vy); //mov cl, [vy]
+		Emit8(0x00); Emit8(0xC8); //add al, cl
+		Emit8(0x0F); Emit8(0x92); Emit8(0xC2); //setc dl
+		EmitMem(0x88, DL, vf); //mov [vf], dl
+		EmitMem(0x00, CL, vx); //add [vx], cl
+		return true;
+
+	case Chip8::OP_8XY5: //8XY5 m_State.registers[X] -= m_State.registers[Y], VF is 0 when there is a borrow
+		EmitMem(0x8A, AL, vx); //mov al, [vx]
+		EmitMem(0x8A, CL, vy); //mov cl, [vy]
+		Emit8(0x38); Emit8(0xC1); //cmp cl, al
+		Emit8(0x0F); Emit8(0x96); Emit8(0xC2); //setbe dl
+		EmitMem(0x88, DL, vf); //mov [vf], dl
+		Emit8(0x28); Emit8(0xC8); //sub al, cl
+		EmitMem(0x88, AL, vx); //mov [vx], al
+		return true;
+
+	case Chip8::OP_8XY6: //8XY6 shift m_State.registers[X] right, VF is the least significant bit
+	case Chip8::OP_8XYE: //8XYE shift m_State.registers[X] left, VF is the least significant bit
+		EmitMem(0x8A, AL, (m_Quirks & Chip8::QUIRK_SHIFT) ? vy : vx); //mov al, [vx] or [vy] with the shift quirk
+		Emit8(0x88); Emit8(0xC2); //mov dl, al
+		Emit8(0x80); Emit8(0xE2); Emit8(0x01); //and dl, 1
+		EmitMem(0x88, DL, vf); //mov [vf], dl
+		Emit8(0xD0); Emit8(ins.op == Chip8::OP_8XY6 ? 0xE8 : 0xE0); //shr / shl al, 1
+		EmitMem(0x88, AL, vx); //mov [vx], al
+		return true;
+
+	case Chip8::OP_8XY7: //8XY7 m_State.registers[X] = m_State.registers[Y] - m_State.registers[X], VF is 0 when there is a borrow
+		EmitMem(0x8A, AL, vx); //mov al, [vx]
+		EmitMem(0x8A, CL, vy); //mov cl, [vy]
+		Emit8(0x38); Emit8(0xC8); //cmp al, cl
+		Emit8(0x0F); Emit8(0x96); Emit8(0xC2); //setbe dl
+		EmitMem(0x88, DL, vf); //mov [vf], dl
+		Emit8(0x28); Emit8(0xC1); //sub cl, al
+		EmitMem(0x88, CL, vx); //mov [vx], cl
+		return true;
+
+	case Chip8::OP_ANNN: //ANNN set m_State.registerIndex to NNN
+		EmitMem(0xC7, 0, m_IndexOffset); Emit32(ins.nnn); //mov dword [index], nnn
+		return true;
+
+	case Chip8::OP_BNNN: //BNNN jump to NNN + m_State.registers[0], or m_State.registers[X] with the jump quirk
+		Emit8(0x0F); EmitMem(0xB6, AL, (m_Quirks & Chip8::QUIRK_JUMP) ? vx : m_RegisterOffset); //movzx eax, byte [v0]
+		Emit8(0x05); Emit32(ins.nnn); //add eax, nnn
+		Emit8(0x66); EmitMem(0x89, AL, m_PositionOffset); //mov [position], ax
+		return true;
+
+	case Chip8::OP_FX1E: //FX1E add m_State.registers[X] to m_State.registerIndex, I wraps at 16 bit or 24 bit for MegaChip
+		Emit8(0x0F); EmitMem(0xB6, AL, vx); //movzx eax, byte [vx]
+		EmitMem(0x03, AL, m_IndexOffset); //add eax, [index]
+		Emit8(0x25); Emit32(m_IndexMask); //and eax, mask
+		EmitMem(0x89, AL, m_IndexOffset); //mov [index], eax
+		return true;
+
+	case Chip8::OP_FX29: //FX29 point m_State.registerIndex to the font character m_State.registers[X]
+		Emit8(0x0F); EmitMem(0xB6, AL, vx); //movzx eax, byte [vx]
+		Emit8(0x8D); Emit8(0x04); Emit8(0x80); //lea eax, [rax + rax * 4]
+		EmitMem(0x89, AL, m_IndexOffset); //mov [index], eax
+		return true;
+	}
+
+	return false;
+}
+
+void Chip8Jit::EmitHandlerCall(const Chip8::Instruction& ins, U16 address)
+{
+	//the handlers advance the memory position relative to the current one
+	EmitStorePosition(address);
+
+#if defined(_WIN32)
+	Emit8(0x48); Emit8(0x89); Emit8(0xD9); //mov rcx, rbx
+	Emit8(0x48); Emit8(0xBA); Emit64(reinterpret_cast<unsigned long long>(&ins)); //mov rdx, &ins
+#else
+	Emit8(0x48); Emit8(0x89); Emit8(0xDF); //mov rdi, rbx
+	Emit8(0x48); Emit8(0xBE); Emit64(reinterpret_cast<unsigned long long>(&ins)); //mov rsi, &ins
+#endif
+	Emit8(0x48); Emit8(0xB8); Emit64(reinterpret_cast<unsigned long long>(&Chip8Jit::CallHandler)); //mov rax, CallHandler
+	Emit8(0xFF); Emit8(0xD0); //call rax
+}
+
+bool Chip8Jit::EndsBlock(U8 op)
+{
+	switch (op)
+	{
+	case Chip8::OP_UNKNOWN:
+	case Chip8::OP_00EE:
+	case Chip8::OP_00FD: //stays at its own address
+	case Chip8::OP_F000: //4 bytes long
+	case Chip8::OP_0010: //MegaChip opcodes are machine code calls on the other machines, 0NNE returns
+	case Chip8::OP_0011:
+	case Chip8::OP_00BN:
+	case Chip8::OP_01NN:
+	case Chip8::OP_02NN:
+	case Chip8::OP_03NN:
+	case Chip8::OP_04NN:
+	case Chip8::OP_05NN:
+	case Chip8::OP_060N:
+	case Chip8::OP_0700:
+	case Chip8::OP_080N:
+	case Chip8::OP_09NN:
+	case Chip8::OP_1NNN:
+	case Chip8::OP_2NNN:
+	case Chip8::OP_3XNN:
+	case Chip8::OP_4XNN:
+	case Chip8::OP_5XY0:
+	case Chip8::OP_9XY0:
+	case Chip8::OP_BNNN:
+	case Chip8::OP_DXYN:
+	case Chip8::OP_EX9E:
+	case Chip8::OP_EXA1:
+	case Chip8::OP_FX0A:
+	case Chip8::OP_5XY2: //writes memory, can overwrite the block
+	case Chip8::OP_FX33:
+	case Chip8::OP_FX55:
+		return true;
+	}
+
+	return false;
+}
+
+void Chip8Jit::CallHandler(Chip8* chip8, const Chip8::Instruction* ins)
+{
+	(chip8->*chip8->m_pHandlers[ins->op])(*ins);
+}
+
+//Encoding helpers
+#pragma region Encoding
+void Chip8Jit::Emit8(U8 value)
+{
+	*m_pCursor++ = value;
+}
+
+void Chip8Jit::Emit16(U16 value)
+{
+	memcpy(m_pCursor, &value, sizeof(value));
+	m_pCursor += sizeof(value);
+}
+
+void Chip8Jit::Emit32(unsigned int value)
+{
+	memcpy(m_pCursor, &value, sizeof(value));
+	m_pCursor += sizeof(value);
+}
+
+void Chip8Jit::Emit64(unsigned long long value)
+{
+	memcpy(m_pCursor, &value, sizeof(value));
+	m_pCursor += sizeof(value);
+}
+
+void Chip8Jit::EmitMem(U8 opcode, int reg, int offset)
+{
+	//ModRM [rbx + disp32]
+	Emit8(opcode);
+	Emit8(static_cast<U8>(0x80 | (reg << 3) | 3));
+	Emit32(static_cast<unsigned int>(offset));
+}
+
+void Chip8Jit::EmitStorePosition(U16 address)
+{
+	Emit8(0x66); EmitMem(0xC7, 0, m_PositionOffset); Emit16(address); //mov word [position], address
+}
+#pragma endregion
@@ -0,0 +1,75 @@
+#pragma once
+#include "Chip8.h"
+
+//Dynamic recompiler that translates hot basic blocks of Chip8 opcodes to x86-64 machine code.
+//A block runs from an address up to and including the next jump, call, return, skip, DXYN or memory write.
+//The Chip8 object is pinned in rbx while a block runs, V0-VF, I and the memory position are addressed relative to it.
+//Opcodes without a native translation call their interpreter handler.
+class Chip8Jit
+{
+public:
+
+	//Constructor
+	Chip8Jit();
+	~Chip8Jit();
+
+	//true when the host can run the generated code
+	bool IsSupported() { return m_pCode != nullptr; }
+
+	//Executes the block at the current memory position if it fits in maxInstructions, otherwise one opcode.
+	//Returns the number of executed opcodes.
+	int Execute(Chip8* chip8, int maxInstructions);
+
+	//Discards the blocks that were translated from [address, address + length)
+	void Invalidate(int address, int length);
+	void Flush();
+
+private:
+
+	typedef void(*BlockFunction)(Chip8* chip8);
+
+	struct Block
+	{
+		BlockFunction function; //nullptr when the block is not translated
+		U8 length; //number of opcodes in the block
+		U8 hits; //executions before the block gets translated
+	};
+
+	//Translation
+	bool Compile(Chip8* chip8, U16 address);
+	bool EmitNative(const Chip8::Instruction& ins, U16 address);
+	void EmitHandlerCall(const Chip8::Instruction& ins, U16 address);
+	static bool EndsBlock(U8 op);
+	static void CallHandler(Chip8* chip8, const Chip8::Instruction* ins);
+
+	//Executable memory, writable only while a block is translated
+	bool SetWritable(bool bWritable);
+	void FreeCode();
+
+	//x86-64 encoding helpers, reg is the index of al/cl/dl/eax/ecx/edx
+	void Emit8(U8 value);
+	void Emit16(U16 value);
+	void Emit32(unsigned int value);
+	void Emit64(unsigned long long value);
+	void EmitMem(U8 opcode, int reg, int offset); //opcode with a [rbx + offset] operand
+	void EmitStorePosition(U16 address);
+
+	//Offsets of the Chip8 state from the Chip8 object
+	int m_RegisterOffset, m_IndexOffset, m_PositionOffset;
+	unsigned int m_Quirks; //quirks of the Chip8 that is being translated
+	bool m_bLongSkips; //XO-CHIP and MegaChip skips depend on the opcode after the skip, they use the handlers
+	int m_MemoryMask; //addresses wrap around the memory of the Chip8, only the first 4 KB are translated
+	U32 m_IndexMask; //I wraps at 16 bit, or 24 bit for MegaChip
+
+	//Executable memory
+	U8* m_pCode;
+	U8* m_pCursor;
+
+	Block m_Blocks[4096]; //translated block per start address
+	bool m_CodeMap[4096]; //true for addresses that are part of a translated block
+
+	const static int CODE_SIZE = 1024 * 1024;
+	const static int MAX_BLOCK_SIZE = 4096; //bytes of machine code a block can take
+	const static int MAX_BLOCK_LENGTH = 64; //opcodes in a block
+	const static int HOT_THRESHOLD = 16;
+};
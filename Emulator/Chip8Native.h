@@ -0,0 +1,30 @@
+#pragma once
+#include "Chip8.h"
+
+//Access to the Chip8 state for the blocks that were recompiled ahead of time by the Recompiler tool.
+//Generated code only uses these helpers, so it keeps working when the layout of Chip8 changes.
+class Chip8Native
+{
+public:
+
+	//State
+	static U8* Registers(Chip8& chip8) { return chip8.m_State.registers; }
+	static U32& Index(Chip8& chip8) { return chip8.m_State.registerIndex; }
+	static U32 IndexMask(Chip8& chip8) { return chip8.GetIndexMask(); }
+	static U16& Position(Chip8& chip8) { return chip8.m_State.memoryPosition; }
+	static U8& DelayTimer(Chip8& chip8) { return chip8.m_State.delayTimer; }
+	static U8& SoundTimer(Chip8& chip8) { return chip8.m_State.soundTimer; }
+
+	//Helpers
+	static bool IsKeyPressed(Chip8& chip8, U8 key) { return chip8.IsKeyPressed(key); }
+	static void DrawSprite(Chip8& chip8, U8 x, U8 y, U8 height) { chip8.DrawPixel(x, y, height); }
+
+	//Runs a single opcode through the interpreter
+	static void Execute(Chip8& chip8, U16 address, U16 opcode)
+	{
+		const Chip8::Instruction& ins = Chip8::s_DecodeTable[opcode];
+
+		chip8.m_State.memoryPosition = address;
+		(chip8.*chip8.m_pHandlers[ins.op])(ins);
+	}
+};
@@ -0,0 +1,256 @@
+#include "ForkPool.h"
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+
+//Constructor
+ForkPool::ForkPool(Chip8& chip8) :
+	m_Chip8(chip8),
+	m_CoreSize(0),
+	m_TableOffset(0),
+	m_RecordSize(0),
+	m_PageCount(0),
+	m_ForkCount(0),
+	m_SyncedCycles(0)
+{
+	Reset();
+}
+
+void ForkPool::Reset()
+{
+	//the mega buffers get table entries in MegaChip mode, whether the screen is on yet or not
+	int sizes[REGION_COUNT];
+	sizes[REGION_SCREEN] = static_cast<int>(sizeof(Chip8::State) - offsetof(Chip8::State, screen));
+	sizes[REGION_MEMORY] = m_Chip8.m_MemorySize;
+	sizes[REGION_MEGA_SCREEN] = (m_Chip8.m_Mode == Chip8::MODE_MEGACHIP) ? Chip8::MEGA_SIZE * 2 : 0;
+	sizes[REGION_MEGA_COLORS] = (m_Chip8.m_Mode == Chip8::MODE_MEGACHIP) ? Chip8::MEGA_SIZE * 2 * static_cast<int>(sizeof(U32)) : 0;
+
+	m_RegionStart[0] = 0;
+	for (int region = 0; region < REGION_COUNT; region++)
+	{
+		m_RegionStart[region + 1] = m_RegionStart[region] + (sizes[region] + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+
+	m_CoreSize = static_cast<int>(offsetof(Chip8::State, screen));
+	m_TableOffset = (m_CoreSize + 3) & ~3;
+	m_RecordSize = (m_TableOffset + m_RegionStart[REGION_COUNT] * static_cast<int>(sizeof(U32)) + 7) & ~7;
+
+	//page 0 is allocated once and never handed out, so a table entry of 0 can mean no page
+	m_Chunks.clear();
+	m_PageRefs.clear();
+	m_FreePages.clear();
+	AllocatePage();
+	m_PageCount = 0;
+
+	m_Records.clear();
+	m_FreeRecords.clear();
+	m_ForkCount = 0;
+
+	//the chip8 doesn't hold any page yet, the first fork copies everything
+	m_Loaded.assign(m_RegionStart[REGION_COUNT], 0);
+	m_SyncedCycles = m_Chip8.m_State.cycles;
+}
+
+int ForkPool::Fork()
+{
+	int fork;
+	if (!m_FreeRecords.empty())
+	{
+		fork = m_FreeRecords.back();
+		m_FreeRecords.pop_back();
+	}
+	else
+	{
+		fork = static_cast<int>(m_Records.size()) / m_RecordSize;
+		m_Records.resize(m_Records.size() + m_RecordSize);
+	}
+	m_ForkCount++;
+
+	memcpy(GetRecord(fork), &m_Chip8.m_State, m_CoreSize);
+	U32* table = GetTable(fork);
+
+	//nothing but memory changes without running, and memory writes are marked
+	bool bRan = m_Chip8.m_State.cycles != m_SyncedCycles;
+
+	for (int region = 0; region < REGION_COUNT; region++)
+	{
+		int size;
+		U8* data = GetRegion(region, size);
+
+		for (int entry = m_RegionStart[region]; entry < m_RegionStart[region + 1]; entry++)
+		{
+			//the mega buffers can change while the MegaChip screen is switched on and off again, they are compared next time
+			if (data == nullptr)
+			{
+				table[entry] = 0;
+				if (bRan)
+				{
+					ReleasePage(m_Loaded[entry]);
+					m_Loaded[entry] = 0;
+				}
+				continue;
+			}
+
+			int index = entry - m_RegionStart[region];
+			int offset = index * PAGE_SIZE;
+			int length = (size - offset < PAGE_SIZE) ? size - offset : PAGE_SIZE;
+
+			//a page that was written but holds the same bytes is still shared
+			U32& loaded = m_Loaded[entry];
+			bool bChanged = (loaded == 0) || ((region == REGION_MEMORY ? IsWritten(index) : bRan) && memcmp(GetPage(loaded), data + offset, length) != 0);
+
+			if (bChanged)
+			{
+				U32 page = AllocatePage();
+				memcpy(GetPage(page), data + offset, length);
+				m_PageRefs[page]++;
+				ReleasePage(loaded);
+				loaded = page;
+			}
+
+			m_PageRefs[loaded]++;
+			table[entry] = loaded;
+		}
+	}
+
+	ClearWritten();
+	m_SyncedCycles = m_Chip8.m_State.cycles;
+	return fork;
+}
+
+void ForkPool::Restore(int fork)
+{
+	bool bRan = m_Chip8.m_State.cycles != m_SyncedCycles;
+
+	memcpy(&m_Chip8.m_State, GetRecord(fork), m_CoreSize);
+	const U32* table = GetTable(fork);
+
+	//a fork taken before the MegaChip screen was on leaves its buffers alone, like LoadState
+	if (m_Chip8.m_State.bMegaChip)
+	{
+		m_Chip8.AllocateMegaScreen();
+	}
+
+	for (int region = 0; region < REGION_COUNT; region++)
+	{
+		int size;
+		U8* data = GetRegion(region, size);
+
+		for (int entry = m_RegionStart[region]; entry < m_RegionStart[region + 1]; entry++)
+		{
+			U32& loaded = m_Loaded[entry];
+			if (data == nullptr)
+			{
+				if (bRan)
+				{
+					ReleasePage(loaded);
+					loaded = 0;
+				}
+				continue;
+			}
+
+			int index = entry - m_RegionStart[region];
+			U32 page = table[entry];
+			if (page == loaded && !(region == REGION_MEMORY ? IsWritten(index) : bRan))
+			{
+				continue;
+			}
+
+			int offset = index * PAGE_SIZE;
+			int length = (size - offset < PAGE_SIZE) ? size - offset : PAGE_SIZE;
+			memcpy(data + offset, GetPage(page), length);
+
+			if (region == REGION_MEMORY)
+			{
+				m_Chip8.InvalidateCode(offset, length);
+			}
+
+			m_PageRefs[page]++;
+			ReleasePage(loaded);
+			loaded = page;
+		}
+	}
+
+	ClearWritten();
+	m_SyncedCycles = m_Chip8.m_State.cycles;
+
+	m_Chip8.m_DirtyRows = ~0ULL;
+	m_Chip8.m_bShouldDraw = true;
+}
+
+void ForkPool::Release(int fork)
+{
+	const U32* table = GetTable(fork);
+	for (int entry = 0; entry < m_RegionStart[REGION_COUNT]; entry++)
+	{
+		ReleasePage(table[entry]);
+	}
+
+	m_FreeRecords.push_back(fork);
+	m_ForkCount--;
+}
+
+//Returns the chip8 memory of a region, nullptr when the chip8 doesn't have it right now
+U8* ForkPool::GetRegion(int region, int& size)
+{
+	//the mega buffers only have table entries in MegaChip mode
+	bool bMega = m_Chip8.m_State.bMegaChip && m_Chip8.m_MegaScreen != nullptr && m_RegionStart[region + 1] > m_RegionStart[region];
+
+	switch (region)
+	{
+	case REGION_SCREEN:
+		size = static_cast<int>(sizeof(Chip8::State)) - m_CoreSize;
+		return reinterpret_cast<U8*>(&m_Chip8.m_State) + m_CoreSize;
+	case REGION_MEMORY:
+		size = m_Chip8.m_MemorySize;
+		return m_Chip8.m_Memory;
+	case REGION_MEGA_SCREEN:
+		size = Chip8::MEGA_SIZE * 2;
+		return bMega ? m_Chip8.m_MegaScreen : nullptr;
+	case REGION_MEGA_COLORS:
+		size = Chip8::MEGA_SIZE * 2 * static_cast<int>(sizeof(U32));
+		return bMega ? reinterpret_cast<U8*>(m_Chip8.m_MegaColors) : nullptr;
+	}
+
+	return nullptr;
+}
+
+void ForkPool::ClearWritten()
+{
+	memset(m_Chip8.m_WrittenPages, 0, ((m_Chip8.m_MemorySize >> Chip8::PAGE_SHIFT) + 63) / 64 * sizeof(U64));
+}
+
+//Pages
+#pragma region Pages
+U32 ForkPool::AllocatePage()
+{
+	U32 page;
+	if (!m_FreePages.empty())
+	{
+		page = m_FreePages.back();
+		m_FreePages.pop_back();
+	}
+	else
+	{
+		page = static_cast<U32>(m_PageRefs.size());
+		if (page % PAGES_PER_CHUNK == 0)
+		{
+			m_Chunks.emplace_back(new U8[PAGES_PER_CHUNK * PAGE_SIZE]);
+		}
+		m_PageRefs.push_back(0);
+	}
+
+	m_PageCount++;
+	return page;
+}
+
+void ForkPool::ReleasePage(U32 page)
+{
+	if (page != 0 && --m_PageRefs[page] == 0)
+	{
+		m_FreePages.push_back(page);
+		m_PageCount--;
+	}
+}
+#pragma endregion
@@ -0,0 +1,86 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Chip8.h"
+
+//Forks of one Chip8 for searches that branch a game many times per frame.
+//A fork holds the registers, timers and stack, and a table of 256 byte pages for memory, the screen and the MegaChip buffers.
+//Pages are shared by every fork that holds the same bytes, a fork only gets its own copy of a page that FX55, FX33, DXYN
+//or any other opcode changed since the fork it came from. The chip8 keeps running on its own memory, the pool remembers
+//which page every part of it holds, so Restore only copies the pages that differ and decoded code elsewhere stays valid.
+//
+//The pool belongs to the chip8 it was made with and follows it from fork to restore. Call Reset after that chip8 loaded a
+//game or a snapshot, the pool only notices changes made by running the chip8.
+class ForkPool
+{
+public:
+
+	//Constructor
+	explicit ForkPool(Chip8& chip8);
+	ForkPool(const ForkPool&) = delete;
+	ForkPool& operator=(const ForkPool&) = delete;
+
+	//Forgets every fork and page
+	void Reset();
+
+	//Forks the current state of the chip8, the id stays valid until it is released
+	int Fork();
+
+	//Puts the chip8 back in the state of a fork, a fork can be restored any number of times
+	void Restore(int fork);
+
+	void Release(int fork);
+
+	int GetForkCount() { return m_ForkCount; }
+	int GetPageCount() { return m_PageCount; } //pages the forks and the chip8 hold
+	int GetForkSize() { return m_RecordSize; } //bytes of a fork apart from its pages
+	const static int PAGE_SIZE = 1 << Chip8::PAGE_SHIFT;
+
+private:
+
+	//Parts of the chip8 that are kept in pages, the mega buffers only while the MegaChip screen is on
+	enum Region
+	{
+		REGION_SCREEN, //the end of the state, see Chip8::State
+		REGION_MEMORY,
+		REGION_MEGA_SCREEN,
+		REGION_MEGA_COLORS,
+		REGION_COUNT
+	};
+
+	U8* GetRegion(int region, int& size);
+	bool IsWritten(int page) { return (m_Chip8.m_WrittenPages[page / 64] >> (page & 63)) & 1; }
+	void ClearWritten();
+
+	//Pages, id 0 is no page
+	U32 AllocatePage();
+	void ReleasePage(U32 page);
+	U8* GetPage(U32 page) { return m_Chunks[page / PAGES_PER_CHUNK].get() + (page % PAGES_PER_CHUNK) * PAGE_SIZE; }
+	const static int PAGES_PER_CHUNK = 256;
+
+	//Forks, the start of the state followed by the page of every table entry
+	U8* GetRecord(int fork) { return m_Records.data() + fork * m_RecordSize; }
+	U32* GetTable(int fork) { return reinterpret_cast<U32*>(GetRecord(fork) + m_TableOffset); }
+
+	Chip8& m_Chip8;
+
+	int m_CoreSize; //bytes of the state before the screen, copied whole
+	int m_RegionStart[REGION_COUNT + 1]; //first table entry of every region
+	int m_TableOffset;
+	int m_RecordSize;
+
+	std::vector<std::unique_ptr<U8[]>> m_Chunks; //PAGES_PER_CHUNK pages each, pages never move
+	std::vector<int> m_PageRefs; //forks holding each page, the chip8 counts as one
+	std::vector<U32> m_FreePages;
+	int m_PageCount;
+
+	std::vector<U8> m_Records;
+	std::vector<int> m_FreeRecords;
+	int m_ForkCount;
+
+	//Page every table entry of the chip8 matches, as of m_SyncedCycles. Memory pages written since then are marked in
+	//Chip8::m_WrittenPages, the other regions only change while the chip8 runs
+	std::vector<U32> m_Loaded;
+	U64 m_SyncedCycles;
+};
@@ -8,7 +8,7 @@ public:
 
 	//Generate Hash using Adler
 	//https://en.wikipedia.org/wiki/Adler-32
-	static unsigned int Adler(char* data, int len)
+	static unsigned int Adler(const char* data, int len)
 	{
 		int a = 1, b = 0;
 		for (int i = 0; i < len; ++i )
@@ -30,4 +30,37 @@ template<typename T>
 std::bitset<sizeof(T) * 8>bin(const T value)
 {
 	return std::bitset<sizeof(T) * 8>(value);
-}
\ No newline at end of file
+}
+
+//Write a length as a varint, 7 bits per byte, the high bit is set when more bytes follow.
+//Returns the output iterator after the last byte
+template<typename Out>
+Out WriteLength(Out out, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = static_cast<unsigned char>(value | 0x80);
+		value >>= 7;
+	}
+
+	*out++ = static_cast<unsigned char>(value);
+	return out;
+}
+
+//Read a varint written by WriteLength, a length that runs past end stops there
+template<typename In>
+unsigned int ReadLength(In& in, In end)
+{
+	unsigned int value = 0;
+	for (int shift = 0; shift < 32 && in != end; shift += 7)
+	{
+		unsigned int byte = static_cast<unsigned char>(*in++);
+		value |= (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			break;
+		}
+	}
+
+	return value;
+}
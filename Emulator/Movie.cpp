@@ -0,0 +1,331 @@
+#include "Movie.h"
+#include "Helpers.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+//Constructor
+Movie::Movie() :
+	m_RomHash(0),
+	m_Seed(0),
+	m_Mode(Chip8::MODE_CHIP8),
+	m_Quirks(0),
+	m_Speed(1),
+	m_KeyframeInterval(0),
+	m_FrameCount(0),
+	m_RecordSpeed(1),
+	m_Cursor(0)
+{
+}
+
+//Recording
+#pragma region Recording
+void Movie::Record(Chip8& chip8, int keyframeInterval)
+{
+	m_RomHash = chip8.GetGameHash();
+	m_Seed = chip8.GetSeed();
+	m_Mode = chip8.GetMode();
+	m_Quirks = chip8.GetQuirks();
+	m_Speed = chip8.GetRunSpeed();
+	m_KeyframeInterval = keyframeInterval > 0 ? keyframeInterval : 1;
+
+	m_Events.clear();
+	m_Keyframes.clear();
+	m_FrameCount = 0;
+	m_RecordSpeed = m_Speed;
+}
+
+void Movie::PressKey(int keyIndex, U8 pressed)
+{
+	Event event = { m_FrameCount, static_cast<U8>((pressed ? CODE_KEY_DOWN : CODE_KEY_UP) + (keyIndex & 0xF)), 0 };
+	m_Events.push_back(event);
+}
+
+void Movie::EndFrame(Chip8& chip8)
+{
+	//the speed doesn't change while a frame runs, a change since the last frame happened before this one
+	int speed = chip8.GetRunSpeed();
+	if (speed != m_RecordSpeed)
+	{
+		Event event = { m_FrameCount, CODE_SPEED, static_cast<U8>(speed) };
+		m_Events.push_back(event);
+		m_RecordSpeed = speed;
+	}
+
+	m_FrameCount++;
+	if (m_FrameCount % m_KeyframeInterval == 0)
+	{
+		Keyframe keyframe;
+		keyframe.frame = m_FrameCount;
+		keyframe.speed = speed;
+		keyframe.state.resize(chip8.GetStateSize());
+		chip8.SaveState(keyframe.state.data());
+		m_Keyframes.push_back(move(keyframe));
+	}
+}
+
+void Movie::DropFrame()
+{
+	if (m_FrameCount == 0)
+	{
+		return;
+	}
+
+	//the input of the rewound frame and the keys pressed since then are forgotten, the frame runs again with new input
+	m_FrameCount--;
+	while (!m_Events.empty() && m_Events.back().frame >= m_FrameCount)
+	{
+		m_Events.pop_back();
+	}
+
+	if (!m_Keyframes.empty() && m_Keyframes.back().frame > m_FrameCount)
+	{
+		m_Keyframes.pop_back();
+	}
+
+	m_RecordSpeed = GetSpeedAt(static_cast<int>(m_Events.size()));
+}
+
+bool Movie::Save(const char* filename)
+{
+	vector<U8> out;
+	Write32(out, MAGIC);
+	Write32(out, VERSION);
+	Write32(out, m_RomHash);
+	Write64(out, m_Seed);
+	Write32(out, m_Mode);
+	Write32(out, m_Quirks);
+	Write32(out, m_Speed);
+	Write32(out, m_KeyframeInterval);
+	Write32(out, m_FrameCount);
+
+	//most frames have no input, the frame gap before an event is usually one byte
+	Write32(out, static_cast<unsigned int>(m_Events.size()));
+	int frame = 0;
+	for (const Event& event : m_Events)
+	{
+		WriteLength(back_inserter(out), event.frame - frame);
+		out.push_back(event.code);
+		if (event.code == CODE_SPEED)
+		{
+			out.push_back(event.speed);
+		}
+
+		frame = event.frame;
+	}
+
+	Write32(out, static_cast<unsigned int>(m_Keyframes.size()));
+	for (const Keyframe& keyframe : m_Keyframes)
+	{
+		Write32(out, keyframe.frame);
+		Write32(out, keyframe.speed);
+		Write32(out, static_cast<unsigned int>(keyframe.state.size()));
+		out.insert(out.end(), keyframe.state.begin(), keyframe.state.end());
+	}
+
+	ofstream file(filename, ios::binary);
+	file.write(reinterpret_cast<const char*>(out.data()), out.size());
+	return file.good();
+}
+#pragma endregion
+
+//Playback
+#pragma region Playback
+bool Movie::Load(const char* filename)
+{
+	ifstream file(filename, ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	vector<U8> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	size_t position = 0;
+	bool bValid = true;
+
+	//every read checks the end of the file, a truncated movie reads as 0 and fails below
+	auto read8 = [&]() -> unsigned int
+	{
+		if (position >= data.size())
+		{
+			bValid = false;
+			return 0;
+		}
+
+		return data[position++];
+	};
+
+	auto read32 = [&]() -> unsigned int
+	{
+		unsigned int value = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			value |= read8() << (i * 8);
+		}
+
+		return value;
+	};
+
+	if (read32() != MAGIC || read32() != VERSION)
+	{
+		return false;
+	}
+
+	m_RomHash = read32();
+	m_Seed = read32();
+	m_Seed |= static_cast<U64>(read32()) << 32;
+	m_Mode = read32();
+	m_Quirks = read32();
+	m_Speed = read32();
+	m_KeyframeInterval = read32();
+	m_FrameCount = read32();
+
+	//a count can't be larger than the bytes left, a corrupt one doesn't allocate gigabytes
+	unsigned int eventCount = read32();
+	if (eventCount > data.size() - position)
+	{
+		return false;
+	}
+
+	m_Events.resize(eventCount);
+	int frame = 0;
+	for (Event& event : m_Events)
+	{
+		vector<U8>::const_iterator in = data.cbegin() + position;
+		frame += ReadLength(in, data.cend());
+		position = in - data.cbegin();
+		event.frame = frame;
+		event.code = static_cast<U8>(read8());
+		event.speed = (event.code == CODE_SPEED) ? static_cast<U8>(read8()) : 0;
+	}
+
+	unsigned int keyframeCount = read32();
+	if (keyframeCount > data.size() - position)
+	{
+		return false;
+	}
+
+	m_Keyframes.resize(keyframeCount);
+	for (Keyframe& keyframe : m_Keyframes)
+	{
+		keyframe.frame = read32();
+		keyframe.speed = read32();
+		unsigned int size = read32();
+		if (size > data.size() - position)
+		{
+			return false;
+		}
+
+		keyframe.state.assign(data.begin() + position, data.begin() + position + size);
+		position += size;
+	}
+
+	m_Cursor = 0;
+	return bValid && m_Mode <= Chip8::MODE_MEGACHIP && m_KeyframeInterval > 0 && m_Quirks < Chip8::QUIRK_COUNT;
+}
+
+bool Movie::Start(Chip8& chip8, const char* rom)
+{
+	//the mode and the seed are taken when the game is loaded, the quirks the game picked are replaced by the recorded ones
+	chip8.SetMode(static_cast<Chip8::Mode>(m_Mode));
+	chip8.SetSeed(m_Seed);
+	if (!chip8.LoadGame(rom) || chip8.GetGameHash() != m_RomHash)
+	{
+		return false;
+	}
+
+	chip8.SetQuirks(m_Quirks);
+	chip8.AdjustSpeed(m_Speed - chip8.GetRunSpeed());
+	m_Cursor = 0;
+
+	//seeking back before the first keyframe starts over from here
+	m_StartState.resize(chip8.GetStateSize());
+	chip8.SaveState(m_StartState.data());
+	return true;
+}
+
+int Movie::Seek(Chip8& chip8, int frame)
+{
+	//keyframe k is the state before frame (k + 1) * interval, the newest one up to frame is found without a search.
+	//A snapshot from a build with another state layout doesn't load, the replay goes back to an older one or to the start
+	int restored = 0;
+	int speed = m_Speed;
+	for (int index = min(frame / m_KeyframeInterval, static_cast<int>(m_Keyframes.size())) - 1; index >= 0; index--)
+	{
+		Keyframe& keyframe = m_Keyframes[index];
+		if (keyframe.frame <= frame && chip8.LoadState(keyframe.state.data(), static_cast<int>(keyframe.state.size())))
+		{
+			restored = keyframe.frame;
+			speed = keyframe.speed;
+			break;
+		}
+	}
+
+	if (restored == 0)
+	{
+		chip8.LoadState(m_StartState.data(), static_cast<int>(m_StartState.size()));
+	}
+
+	//the frames before the keyframe are covered by it, their input is skipped
+	chip8.AdjustSpeed(speed - chip8.GetRunSpeed());
+	Event first = { restored, 0, 0 };
+	m_Cursor = static_cast<int>(lower_bound(m_Events.begin(), m_Events.end(), first,
+		[](const Event& a, const Event& b) { return a.frame < b.frame; }) - m_Events.begin());
+
+	return restored;
+}
+
+void Movie::PlayFrame(Chip8& chip8, int frame)
+{
+	while (m_Cursor < static_cast<int>(m_Events.size()) && m_Events[m_Cursor].frame <= frame)
+	{
+		Apply(chip8, m_Events[m_Cursor++]);
+	}
+
+	chip8.Run();
+}
+
+void Movie::Apply(Chip8& chip8, const Event& event)
+{
+	if (event.code == CODE_SPEED)
+	{
+		chip8.AdjustSpeed(event.speed - chip8.GetRunSpeed());
+	}
+	else
+	{
+		chip8.PressKey(event.code & 0xF, (event.code & CODE_KEY_DOWN) ? 1 : 0);
+	}
+}
+
+int Movie::GetSpeedAt(int eventCount)
+{
+	for (int i = eventCount - 1; i >= 0; i--)
+	{
+		if (m_Events[i].code == CODE_SPEED)
+		{
+			return m_Events[i].speed;
+		}
+	}
+
+	return m_Speed;
+}
+#pragma endregion
+
+//File helpers
+#pragma region File
+void Movie::Write32(vector<U8>& out, unsigned int value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		out.push_back(static_cast<U8>(value >> (i * 8)));
+	}
+}
+
+void Movie::Write64(vector<U8>& out, U64 value)
+{
+	Write32(out, static_cast<unsigned int>(value));
+	Write32(out, static_cast<unsigned int>(value >> 32));
+}
+#pragma endregion
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+
+#include "Chip8.h"
+
+//Input movie of a game played from the moment it was loaded.
+//Key presses and speed changes are stamped with the frame they happened before, so replaying them with the same
+//rom, mode, quirks and seed gives the same game down to every opcode. A snapshot is kept every keyframe interval,
+//so a replay can start at the keyframe before any frame and only runs the frames after it.
+//
+//File layout, little endian:
+//  "C8MV", version, rom hash, seed, mode, quirks, speed, keyframe interval, frame count
+//  event count, events: frame delta as a 7 bit varint, code, the new speed after a speed code
+//  keyframe count, keyframes: frame, speed, snapshot size, snapshot
+//Snapshots are Chip8::SaveState bytes, a build with a different state layout falls back to replaying from frame 0
+class Movie
+{
+public:
+
+	//Constructor
+	Movie();
+
+	//Recording, Record is called right after the game was loaded
+	void Record(Chip8& chip8, int keyframeInterval);
+	void PressKey(int keyIndex, U8 pressed); //stamped with the frame that runs next
+	void EndFrame(Chip8& chip8); //after every frame the chip8 ran
+	void DropFrame(); //the last frame was rewound, its input is forgotten
+	bool Save(const char* filename);
+
+	//Playback
+	bool Load(const char* filename);
+	bool Start(Chip8& chip8, const char* rom); //loads the rom the way it was recorded, false when it isn't the recorded rom
+	int Seek(Chip8& chip8, int frame); //restores the last keyframe up to frame after Start, returns the frame it restored
+	void PlayFrame(Chip8& chip8, int frame); //applies the input of frame and runs it, frames are played in order after Seek
+
+	//Getters
+	int GetFrameCount() { return m_FrameCount; }
+	unsigned int GetRomHash() { return m_RomHash; }
+	U64 GetSeed() { return m_Seed; }
+
+private:
+
+	//Event codes, a key index is added to the key codes
+	enum Code
+	{
+		CODE_KEY_UP = 0x00,
+		CODE_KEY_DOWN = 0x10,
+		CODE_SPEED = 0x20
+	};
+
+	struct Event
+	{
+		int frame;
+		U8 code;
+		U8 speed; //CODE_SPEED only
+	};
+
+	struct Keyframe
+	{
+		int frame; //the snapshot is taken before the input of this frame
+		int speed; //opcodes per frame are a setting, not part of the snapshot
+		std::vector<U8> state;
+	};
+
+	void Apply(Chip8& chip8, const Event& event);
+	int GetSpeedAt(int eventCount); //speed after the first eventCount events
+
+	//File helpers
+	static void Write32(std::vector<U8>& out, unsigned int value);
+	static void Write64(std::vector<U8>& out, U64 value);
+	const static unsigned int MAGIC = 0x564D3843; //"C8MV"
+	const static unsigned int VERSION = 1;
+
+	//Recorded settings
+	unsigned int m_RomHash;
+	U64 m_Seed;
+	int m_Mode;
+	unsigned int m_Quirks;
+	int m_Speed; //speed of the first frame
+	int m_KeyframeInterval;
+
+	std::vector<Event> m_Events; //in frame order
+	std::vector<Keyframe> m_Keyframes; //one every m_KeyframeInterval frames, starting at m_KeyframeInterval
+	int m_FrameCount;
+
+	int m_RecordSpeed; //speed of the last recorded frame
+	int m_Cursor; //next event PlayFrame applies
+	std::vector<U8> m_StartState; //the game as Start loaded it
+};
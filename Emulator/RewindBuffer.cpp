@@ -0,0 +1,253 @@
+#include "RewindBuffer.h"
+#include "Helpers.h"
+#include <cstring>
+
+using namespace std;
+
+//Constructor
+RewindBuffer::RewindBuffer(int ringSize, int maxCheckpoints) :
+	m_Current(nullptr),
+	m_Next(nullptr),
+	m_Scratch(nullptr),
+	m_CurrentSize(0),
+	m_NextSize(0),
+	m_Capacity(0),
+	m_Ring(new U8[ringSize]),
+	m_RingSize(ringSize),
+	m_WritePosition(0),
+	m_Checkpoints(new Checkpoint[maxCheckpoints]),
+	m_MaxCheckpoints(maxCheckpoints),
+	m_First(0),
+	m_Count(0)
+{
+}
+
+//Destructor
+RewindBuffer::~RewindBuffer()
+{
+	delete[] m_Current;
+	delete[] m_Next;
+	delete[] m_Scratch;
+	delete[] m_Ring;
+	delete[] m_Checkpoints;
+}
+
+void RewindBuffer::Reset(Chip8& chip8)
+{
+	//the buffers only grow when a game needs bigger snapshots than every game before it
+	int capacity = chip8.GetMaxStateSize();
+	if (capacity > m_Capacity)
+	{
+		delete[] m_Current;
+		delete[] m_Next;
+		delete[] m_Scratch;
+
+		//a delta is at most one length pair longer than the snapshot, every run of XORed bytes is followed by at least
+		//MIN_UNCHANGED_RUN unchanged bytes that pay for the next pair
+		m_Current = new U8[capacity];
+		m_Next = new U8[capacity];
+		m_Scratch = new U8[capacity + 16];
+		m_Capacity = capacity;
+	}
+
+	memset(m_Current, 0, m_Capacity);
+	memset(m_Next, 0, m_Capacity);
+	m_CurrentSize = chip8.GetStateSize();
+	m_NextSize = 0;
+	chip8.SaveState(m_Current);
+
+	m_WritePosition = 0;
+	m_First = 0;
+	m_Count = 0;
+}
+
+void RewindBuffer::Push(Chip8& chip8)
+{
+	int size = chip8.GetStateSize();
+	if (size > m_Capacity)
+	{
+		//the game was loaded without a Reset
+		Reset(chip8);
+		return;
+	}
+
+	chip8.SaveState(m_Next);
+	if (m_NextSize > size)
+	{
+		memset(m_Next + size, 0, m_NextSize - size);
+	}
+
+	//the delta covers the larger snapshot, the other one reads as 0 past its end
+	int length = Encode(m_Current, m_Next, (size > m_CurrentSize) ? size : m_CurrentSize, m_Scratch);
+	Store(length, m_CurrentSize);
+
+	U8* previous = m_Current;
+	m_Current = m_Next;
+	m_Next = previous;
+	m_NextSize = m_CurrentSize;
+	m_CurrentSize = size;
+}
+
+bool RewindBuffer::Pop(Chip8& chip8)
+{
+	if (m_Count == 0)
+	{
+		return false;
+	}
+
+	//XORing the newest delta turns the current snapshot back into the one before it
+	const Checkpoint& checkpoint = m_Checkpoints[(m_First + m_Count - 1) % m_MaxCheckpoints];
+	Decode(m_Ring + checkpoint.offset, checkpoint.length, m_Current);
+	m_CurrentSize = checkpoint.size;
+
+	m_WritePosition = checkpoint.offset;
+	m_Count--;
+
+	return chip8.LoadState(m_Current, m_CurrentSize);
+}
+
+int RewindBuffer::GetUsedSize()
+{
+	int used = 0;
+	for (int i = 0; i < m_Count; i++)
+	{
+		used += m_Checkpoints[(m_First + i) % m_MaxCheckpoints].length;
+	}
+
+	return used;
+}
+
+//Ring
+#pragma region Ring
+void RewindBuffer::Store(int length, int size)
+{
+	//a delta bigger than the whole ring can't be kept, the frames before it can't be reached anymore
+	if (length > m_RingSize)
+	{
+		m_WritePosition = 0;
+		m_First = 0;
+		m_Count = 0;
+		return;
+	}
+
+	//checkpoints are never split, a delta that doesn't fit before the end of the ring goes to the start.
+	//The checkpoints left between the write position and the end are older than the ones at the start, they go first
+	if (m_WritePosition + length > m_RingSize)
+	{
+		while (m_Count > 0 && m_Checkpoints[m_First].offset >= m_WritePosition)
+		{
+			DropOldest();
+		}
+
+		m_WritePosition = 0;
+	}
+
+	//the checkpoints after the write position are the oldest ones, drop them until the delta fits
+	while (m_Count > 0)
+	{
+		const Checkpoint& oldest = m_Checkpoints[m_First];
+		if (oldest.offset >= m_WritePosition + length || oldest.offset + oldest.length <= m_WritePosition)
+		{
+			break;
+		}
+
+		DropOldest();
+	}
+
+	if (m_Count == m_MaxCheckpoints)
+	{
+		DropOldest();
+	}
+
+	memcpy(m_Ring + m_WritePosition, m_Scratch, length);
+
+	Checkpoint& checkpoint = m_Checkpoints[(m_First + m_Count) % m_MaxCheckpoints];
+	checkpoint.offset = m_WritePosition;
+	checkpoint.length = length;
+	checkpoint.size = size;
+	m_Count++;
+
+	m_WritePosition += length;
+}
+
+void RewindBuffer::DropOldest()
+{
+	m_First = (m_First + 1) % m_MaxCheckpoints;
+	m_Count--;
+}
+#pragma endregion
+
+//Delta encoding
+#pragma region Encoding
+int RewindBuffer::Encode(const U8* previous, const U8* current, int size, U8* out)
+{
+	U8* start = out;
+	int i = 0;
+
+	while (i < size)
+	{
+		//unchanged bytes, compared 8 at a time
+		int unchanged = i;
+		while (i + 8 <= size && memcmp(previous + i, current + i, 8) == 0)
+		{
+			i += 8;
+		}
+
+		while (i < size && previous[i] == current[i])
+		{
+			i++;
+		}
+
+		//nothing changed up to the end, decoding stops at the end of the delta anyway
+		if (i == size)
+		{
+			break;
+		}
+
+		//changed bytes, up to the next run of unchanged bytes that is worth its own length pair
+		int changed = i;
+		int run = 0;
+		for (; i < size; i++)
+		{
+			if (previous[i] != current[i])
+			{
+				run = 0;
+			}
+			else if (++run == MIN_UNCHANGED_RUN)
+			{
+				i++;
+				break;
+			}
+		}
+		i -= run;
+
+		out = WriteLength(out, changed - unchanged);
+		out = WriteLength(out, i - changed);
+		for (int j = changed; j < i; j++)
+		{
+			*out++ = previous[j] ^ current[j];
+		}
+	}
+
+	return static_cast<int>(out - start);
+}
+
+void RewindBuffer::Decode(const U8* in, int length, U8* state)
+{
+	const U8* end = in + length;
+	int i = 0;
+
+	while (in < end)
+	{
+		i += ReadLength(in, end);
+		int changed = ReadLength(in, end);
+		for (int j = 0; j < changed; j++)
+		{
+			state[i + j] ^= in[j];
+		}
+
+		in += changed;
+		i += changed;
+	}
+}
+#pragma endregion
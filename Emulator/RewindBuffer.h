@@ -0,0 +1,63 @@
+#pragma once
+#include "Chip8.h"
+
+//Keeps the last frames of a Chip8 so a game can be played backwards.
+//Only the newest snapshot is stored whole. Every older frame is a checkpoint holding the XOR of its snapshot with the
+//snapshot of the frame after it, with the unchanged bytes run-length encoded. Most of memory and the screen stay the same
+//between frames, so a checkpoint is usually a few dozen bytes. Checkpoints live in a fixed ring, the oldest ones are
+//overwritten, and nothing is allocated after Reset.
+class RewindBuffer
+{
+public:
+
+	//Constructor
+	RewindBuffer(int ringSize, int maxCheckpoints);
+	~RewindBuffer();
+	RewindBuffer(const RewindBuffer&) = delete;
+	RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+	//Forgets every checkpoint and starts over from the current state of the chip8, called when a game is loaded
+	void Reset(Chip8& chip8);
+
+	//Stores the frame the chip8 just ran
+	void Push(Chip8& chip8);
+
+	//Restores the frame before the last one that was pushed, false when there is nothing left to rewind
+	bool Pop(Chip8& chip8);
+
+	int GetCheckpointCount() { return m_Count; }
+	int GetUsedSize(); //bytes of the ring the checkpoints take
+
+private:
+
+	struct Checkpoint
+	{
+		int offset; //position of the encoded delta in the ring
+		int length; //bytes of the encoded delta
+		int size; //size of the snapshot the delta restores
+	};
+
+	//Delta encoding, a run of unchanged bytes followed by a run of XORed bytes, both lengths as 7 bit varints
+	static int Encode(const U8* previous, const U8* current, int size, U8* out);
+	static void Decode(const U8* in, int length, U8* state);
+	const static int MIN_UNCHANGED_RUN = 8; //shorter runs are cheaper to store as XORed bytes than as a new run
+
+	void Store(int length, int size);
+	void DropOldest();
+
+	//Snapshots, bytes after the size of a snapshot are always 0 so snapshots of a different size can be XORed
+	U8* m_Current; //the frame that was pushed last
+	U8* m_Next;
+	U8* m_Scratch; //encoded delta before it is copied to the ring
+	int m_CurrentSize, m_NextSize;
+	int m_Capacity; //largest snapshot the buffers hold
+
+	//Ring
+	U8* m_Ring;
+	int m_RingSize;
+	int m_WritePosition; //the next checkpoint is written here, or at the start when it doesn't fit
+	Checkpoint* m_Checkpoints;
+	int m_MaxCheckpoints;
+	int m_First; //index of the oldest checkpoint
+	int m_Count;
+};
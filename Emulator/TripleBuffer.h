@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+
+//Hands buffers from one producer thread to one consumer thread without locks.
+//The producer fills the back buffer and publishes it, the consumer takes the latest published buffer.
+//Neither side ever waits: a buffer that was published but not taken yet is simply replaced by the next one.
+template<typename T>
+class TripleBuffer
+{
+public:
+
+	TripleBuffer():
+		m_Back(0),
+		m_Middle(1),
+		m_Front(2)
+	{
+	}
+
+	//Producer
+	T& GetBack() { return m_Buffers[m_Back]; }
+
+	//Publishes the back buffer and returns the next one to fill.
+	//bSkipped is set when the buffer published before was never taken, the returned buffer is that one.
+	T& Publish(bool& bSkipped)
+	{
+		int middle = m_Middle.exchange(m_Back | FRESH, std::memory_order_acq_rel);
+		m_Back = middle & INDEX;
+		bSkipped = (middle & FRESH) != 0;
+
+		return m_Buffers[m_Back];
+	}
+
+	//Consumer
+	const T& GetFront() { return m_Buffers[m_Front]; }
+
+	//Takes the latest published buffer, returns false when nothing was published since the last call
+	bool Acquire()
+	{
+		if ((m_Middle.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+
+		m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+private:
+
+	const static int INDEX = 3; //buffer index bits of m_Middle
+	const static int FRESH = 4; //set while the middle buffer wasn't taken by the consumer
+
+	T m_Buffers[3];
+	int m_Back; //only touched by the producer
+	std::atomic<int> m_Middle; //index of the buffer being handed over + FRESH
+	int m_Front; //only touched by the consumer
+};
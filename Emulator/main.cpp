@@ -1,11 +1,19 @@
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 //OpenGL includes
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "Chip8.h"
+#include "TripleBuffer.h"
+#include "RewindBuffer.h"
+#include "Movie.h"
 
 
 using namespace std;
@@ -24,10 +32,19 @@ protected:
 };
 
 // Function prototypes
+struct Frame;
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void drop_callback(GLFWwindow* window, int amount, const char** files);
-void UpdateTexture(Chip8 * chip8);
+void refresh_callback(GLFWwindow* window);
+void UpdateTexture(const Frame& frame, U64 dirty);
+void UpdatePalette();
+void CreatePixelBuffers();
+void DeletePixelBuffers();
+void EmulationLoop();
 void ResetChip8();
+void LoadGame();
+void PressKey(int keyIndex, U8 pressed);
+void StopRecording();
 string GetWindowTitle();
 
 //Constants	
@@ -44,6 +61,13 @@ const int BLACKCOLOR = 50;
 const int WHITECOLOR = 215;
 const int UPSCALE_FACTOR = 20;
 
+//Rewind, about ten minutes of a typical game fit in the ring
+const int REWIND_BUFFER_SIZE = 4 * 1024 * 1024;
+const int REWIND_CHECKPOINTS = 60 * 60 * 10;
+
+//Movies, a replay seeks to any frame by running at most ten seconds from a keyframe
+const int MOVIE_KEYFRAME_INTERVAL = 60 * 10;
+
 #pragma endregion
 
 //Shaders
@@ -62,19 +86,97 @@ const GLchar* vertexSource =
 
 "}";
 
+//The texture holds the packed chip8 rows, 32 pixels per texel. Every 64 pixel row word is uploaded as
+//its low half followed by its high half and the left pixel is the highest bit.
+//The texture fits the hires screen, screenSize is the part the current resolution uses.
+//The XO-CHIP planes are stacked in the texture, the second one starts halfway down.
+//The MegaChip screen is a second texture that already holds the colors.
 const GLchar* fragmentSource =
 "#version 150 core\n"
 
 "in vec2 TexCoord;"
 "out vec4 outColor;"
-"uniform sampler2D tex;"
+"uniform usampler2D tex;"
+"uniform sampler2D megaTex;"
+"uniform bool megaChip;"
+"uniform float screenAlpha;"
+"uniform vec3 palette[4];"
+"uniform ivec2 screenSize;"
 "void main() {"
-"	outColor = texture(tex,TexCoord);"
+"	if (megaChip) {"
+"		outColor = vec4(texture(megaTex, TexCoord).rgb * screenAlpha, 1.0);"
+"		return;"
+"	}"
+"	ivec2 pixel = min(ivec2(TexCoord * vec2(screenSize)), screenSize - 1);"
+"	int texel = (pixel.x / 64) * 2 + 1 - (pixel.x / 32) % 2;"
+"	int planeHeight = textureSize(tex, 0).y / 2;"
+"	uint shift = uint(31 - pixel.x % 32);"
+"	uint low = (texelFetch(tex, ivec2(texel, pixel.y), 0).r >> shift) & 1u;"
+"	uint high = (texelFetch(tex, ivec2(texel, pixel.y + planeHeight), 0).r >> shift) & 1u;"
+"	outColor = vec4(palette[int(low | (high << 1))], 1.0);"
 "}";
 #pragma endregion 
 
+//Pixel buffers
+#pragma region Pixel Buffer Ring
+//glBufferStorage is core in 4.4 only, so it is loaded by hand when GL_ARB_buffer_storage is there
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+//The screen rows are written to one of these before the texture upload reads them, so the next frame
+//never waits for the driver to finish with the previous one
+const int PIXEL_BUFFER_COUNT = 3;
+const GLsizeiptr PIXEL_BUFFER_SIZE = Chip8::MEGA_SIZE * sizeof(U32); //the MegaChip colors, more than the packed planes take
+
+struct PixelBuffer
+{
+	GLuint buffer;
+	void* pMapped; //persistent mapping, nullptr when the buffer is orphaned on every upload
+	GLsync fence; //signaled once the upload that reads the buffer is done
+};
+
+PixelBuffer m_pixelBuffers[PIXEL_BUFFER_COUNT];
+int m_pixelBufferIndex = 0;
+#pragma endregion
+
+//Emulation thread
+#pragma region Emulation Thread
+//Screen published by the emulation thread
+struct Frame
+{
+	U64 rows[Chip8::PLANES][Chip8::SCREEN_WORDS]; //width / 64 words per row
+	U32 colors[Chip8::MEGA_SIZE]; //ARGB MegaChip screen, only copied while bMegaChip is set
+	U64 dirty; //rows that changed in any plane since the frame published before, every bit for a MegaChip screen
+	U64 number; //counts published frames, the render thread sees a gap when frames it never took were replaced
+	int width, height;
+	bool bMegaChip;
+	int alpha;
+};
+
+TripleBuffer<Frame> m_frames;
+thread m_emulationThread;
+mutex m_chip8Mutex; //held while the emulation thread runs a frame and while the input changes m_chip8
+atomic<bool> m_bEmulating(false);
+atomic<bool> m_bBeep(false);
+atomic<bool> m_bRewinding(false); //the rewind key is held, the emulation thread steps back a frame at a time
+RewindBuffer m_rewind(REWIND_BUFFER_SIZE, REWIND_CHECKPOINTS); //only used by whoever holds m_chip8Mutex
+Movie m_movie; //only used by whoever holds m_chip8Mutex
+bool m_bRecording = false; //the input goes to m_movie, guarded by m_chip8Mutex
+bool m_bRedraw = true; //the window has to be presented again even though no new frame arrived
+#pragma endregion
+
 //Size of Chip8 screen + 3 channels(RGB)
-unsigned char m_screenData[Chip8::WIDTH*Chip8::HEIGHT][3];
+GLint m_paletteLocation;
+GLint m_screenSizeLocation;
+GLint m_megaChipLocation;
+GLint m_screenAlphaLocation;
+GLuint m_megaTexture;
+int m_screenWidth = 0; //resolution the shader is set up for
 Chip8* m_chip8;
 GLFWwindow* m_Window;
 
@@ -112,6 +214,10 @@ int main()
 	// Set the required callback functions
 	glfwSetKeyCallback(m_Window, key_callback);
 	glfwSetDropCallback(m_Window, drop_callback);
+	glfwSetWindowRefreshCallback(m_Window, refresh_callback);
+
+	//swap at the refresh rate of the display
+	glfwSwapInterval(1);
 
 	if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
 	{
@@ -189,17 +295,15 @@ int main()
 	
 #pragma endregion 
 	
-	//4. Create black texture to draw m_chip8 on
+	//4. Create texture to draw m_chip8 on
 	#pragma region OpenGL Texture Creation
-	for (auto x = 0; x < Chip8::WIDTH * Chip8::HEIGHT; x++)
-		m_screenData[x][0] = m_screenData[x][1] = m_screenData[x][2] = m_screenData[x][3] = 0; 
-
 	//create openGL texture
 	GLuint tex;
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Chip8::WIDTH, Chip8::HEIGHT , 0, GL_RGBA, GL_UNSIGNED_BYTE, m_screenData);
+	//the texture is allocated once with one bit per pixel, UpdateTexture only replaces the rows that changed
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, Chip8::HIRES_WIDTH / 32, Chip8::HIRES_HEIGHT * Chip8::PLANES, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
 
 	//set to nearest for per pixel
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -208,26 +312,71 @@ int main()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
 	glEnable(GL_TEXTURE_2D);
+
+	//the MegaChip screen is uploaded as colors on the second texture unit
+	glActiveTexture(GL_TEXTURE1);
+	glGenTextures(1, &m_megaTexture);
+	glBindTexture(GL_TEXTURE_2D, m_megaTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Chip8::MEGA_WIDTH, Chip8::MEGA_HEIGHT, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glActiveTexture(GL_TEXTURE0);
+
+	//the shader maps the pixels to colors
+	glUniform1i(glGetUniformLocation(shaderProgram, "megaTex"), 1);
+	m_paletteLocation = glGetUniformLocation(shaderProgram, "palette");
+	m_screenSizeLocation = glGetUniformLocation(shaderProgram, "screenSize");
+	m_megaChipLocation = glGetUniformLocation(shaderProgram, "megaChip");
+	m_screenAlphaLocation = glGetUniformLocation(shaderProgram, "screenAlpha");
+	glUniform1f(m_screenAlphaLocation, 1.0f);
+	UpdatePalette();
+
+	//the rows reach the texture through a ring of pixel unpack buffers
+	CreatePixelBuffers();
 	#pragma endregion 
 
 	//5. Create m_chip8 Object and load a game	
 	m_chip8 = new Chip8();
-	m_chip8->LoadGame(GAME.c_str());
+	LoadGame();
+
+	//the chip8 runs on its own thread, this one only renders
+	m_bEmulating = true;
+	m_emulationThread = thread(EmulationLoop);
+
+	U64 lastFrame = 0; //number of the frame in the texture
 
 	// Game loop
 	while (!glfwWindowShouldClose(m_Window))
 	{
-		// Check if any events have been activated (key pressed, mouse moved etc.) and call corresponding response functions
-		glfwPollEvents();
+		//Sleep until an event arrives (key pressed, window exposed etc.) and call corresponding response functions.
+		//The emulation thread posts an empty event when it published a frame, so static screens cost nothing
+		glfwWaitEvents();
+
+		//Update texture with the latest screen the emulation thread finished
+		bool bPresent = m_bRedraw;
+		m_bRedraw = false;
+		if (m_frames.Acquire())
+		{
+			//the rows of frames that were replaced before this thread took them aren't in this one, every row is uploaded again
+			const Frame& frame = m_frames.GetFront();
+			UpdateTexture(frame, (frame.number == lastFrame + 1) ? frame.dirty : ~0ULL);
+			lastFrame = frame.number;
+			bPresent = true;
+		}
 
-		//Update texture when draw flag is set(optimizes performance)
-		if (m_chip8->shouldDraw())
+		//play system beep
+		if (m_bBeep.exchange(false))
 		{
-			UpdateTexture(m_chip8);
+			cout << "\a";
 		}
 
-		//run chip8 
-		m_chip8->Run();			
+		//the framebuffer still shows the last frame
+		if (!bPresent)
+		{
+			continue;
+		}
 
 		// Render
 		// Clear the color buffer
@@ -238,23 +387,28 @@ int main()
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
 		// Swap the screen buffers
-		glfwSwapInterval(1);
 		glfwSwapBuffers(m_Window);
 	}
 
-	//clean up m_chip8;
+	//stop the emulation thread and clean up m_chip8;
+	m_bEmulating = false;
+	m_emulationThread.join();
+	StopRecording();
 	delete m_chip8;
 
-	// Terminates GLFW, clearing any resources allocated by GLFW.
-	glfwTerminate();
-
 	//clean up program
+	DeletePixelBuffers();
+	glDeleteTextures(1, &tex);
+	glDeleteTextures(1, &m_megaTexture);
 	glDeleteProgram(shaderProgram);
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
 	glDeleteBuffers(1,&ebo);
 	glDeleteBuffers(1, &vbo);
 	glDeleteVertexArrays(1, &vao);
+
+	// Terminates GLFW, clearing any resources allocated by GLFW.
+	glfwTerminate();
 	
 	return 0;
 }
@@ -266,60 +420,63 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	UNREFERENCED_PARAMETER(mode);
 	UNREFERENCED_PARAMETER(scancode);
 
+	//the emulation thread can't run a frame while the input changes the chip8
+	lock_guard<mutex> lock(m_chip8Mutex);
+
 	//Chip8 keys (0 == released, 1 == Pressed)
 
 	//Chip 8 specific input
 	//1, 2 , 3 , C
-	if (key == GLFW_KEY_1 && action == GLFW_RELEASE) m_chip8->PressKey(1, 0);
-	else if (key == GLFW_KEY_2 && action == GLFW_RELEASE) m_chip8->PressKey(2, 0);
-	else if (key == GLFW_KEY_3 && action == GLFW_RELEASE) m_chip8->PressKey(3, 0);
-	else if (key == GLFW_KEY_4 && action == GLFW_RELEASE) m_chip8->PressKey(12, 0);
+	if (key == GLFW_KEY_1 && action == GLFW_RELEASE) PressKey(1, 0);
+	else if (key == GLFW_KEY_2 && action == GLFW_RELEASE) PressKey(2, 0);
+	else if (key == GLFW_KEY_3 && action == GLFW_RELEASE) PressKey(3, 0);
+	else if (key == GLFW_KEY_4 && action == GLFW_RELEASE) PressKey(12, 0);
 
 
 	//4,5,6,
-	else if (key == GLFW_KEY_Q && action == GLFW_RELEASE) m_chip8->PressKey(4, 0);
-	else if (key == GLFW_KEY_W && action == GLFW_RELEASE) m_chip8->PressKey(5, 0);
-	else if (key == GLFW_KEY_E && action == GLFW_RELEASE) m_chip8->PressKey(6, 0);
-	else if (key == GLFW_KEY_R && action == GLFW_RELEASE) m_chip8->PressKey(13, 0);
+	else if (key == GLFW_KEY_Q && action == GLFW_RELEASE) PressKey(4, 0);
+	else if (key == GLFW_KEY_W && action == GLFW_RELEASE) PressKey(5, 0);
+	else if (key == GLFW_KEY_E && action == GLFW_RELEASE) PressKey(6, 0);
+	else if (key == GLFW_KEY_R && action == GLFW_RELEASE) PressKey(13, 0);
 
 	//7,8,9,E
-	else if (key == GLFW_KEY_A && action == GLFW_RELEASE) m_chip8->PressKey(7, 0);
-	else if (key == GLFW_KEY_S && action == GLFW_RELEASE) m_chip8->PressKey(8, 0);
-	else if (key == GLFW_KEY_D && action == GLFW_RELEASE) m_chip8->PressKey(9, 0);
-	else if (key == GLFW_KEY_F && action == GLFW_RELEASE) m_chip8->PressKey(14, 0);
+	else if (key == GLFW_KEY_A && action == GLFW_RELEASE) PressKey(7, 0);
+	else if (key == GLFW_KEY_S && action == GLFW_RELEASE) PressKey(8, 0);
+	else if (key == GLFW_KEY_D && action == GLFW_RELEASE) PressKey(9, 0);
+	else if (key == GLFW_KEY_F && action == GLFW_RELEASE) PressKey(14, 0);
 
 	//A, 0, B, F
-	else if (key == GLFW_KEY_Z && action == GLFW_RELEASE) m_chip8->PressKey(10, 0);
-	else if (key == GLFW_KEY_X && action == GLFW_RELEASE) m_chip8->PressKey(0, 0);
-	else if (key == GLFW_KEY_C && action == GLFW_RELEASE) m_chip8->PressKey(11, 0);
-	else if (key == GLFW_KEY_V && action == GLFW_RELEASE) m_chip8->PressKey(15, 0);
+	else if (key == GLFW_KEY_Z && action == GLFW_RELEASE) PressKey(10, 0);
+	else if (key == GLFW_KEY_X && action == GLFW_RELEASE) PressKey(0, 0);
+	else if (key == GLFW_KEY_C && action == GLFW_RELEASE) PressKey(11, 0);
+	else if (key == GLFW_KEY_V && action == GLFW_RELEASE) PressKey(15, 0);
 
 
 	//PRESSED
 	//1, 2 , 3 , C
-	if (key == GLFW_KEY_1 && action == GLFW_PRESS) m_chip8->PressKey(1, 1);
-	else if (key == GLFW_KEY_2 && action == GLFW_PRESS) m_chip8->PressKey(2, 1);
-	else if (key == GLFW_KEY_3 && action == GLFW_PRESS) m_chip8->PressKey(3, 1);
-	else if (key == GLFW_KEY_4 && action == GLFW_PRESS) m_chip8->PressKey(12, 1);
+	if (key == GLFW_KEY_1 && action == GLFW_PRESS) PressKey(1, 1);
+	else if (key == GLFW_KEY_2 && action == GLFW_PRESS) PressKey(2, 1);
+	else if (key == GLFW_KEY_3 && action == GLFW_PRESS) PressKey(3, 1);
+	else if (key == GLFW_KEY_4 && action == GLFW_PRESS) PressKey(12, 1);
 
 
 	//4,5,6,
-	else if (key == GLFW_KEY_Q && action == GLFW_PRESS) m_chip8->PressKey(4, 1);
-	else if (key == GLFW_KEY_W && action == GLFW_PRESS) m_chip8->PressKey(5, 1);
-	else if (key == GLFW_KEY_E && action == GLFW_PRESS) m_chip8->PressKey(6, 1);
-	else if (key == GLFW_KEY_R && action == GLFW_PRESS) m_chip8->PressKey(13, 1);
+	else if (key == GLFW_KEY_Q && action == GLFW_PRESS) PressKey(4, 1);
+	else if (key == GLFW_KEY_W && action == GLFW_PRESS) PressKey(5, 1);
+	else if (key == GLFW_KEY_E && action == GLFW_PRESS) PressKey(6, 1);
+	else if (key == GLFW_KEY_R && action == GLFW_PRESS) PressKey(13, 1);
 
 	//7,8,9,E
-	else if (key == GLFW_KEY_A && action == GLFW_PRESS) m_chip8->PressKey(7, 1);
-	else if (key == GLFW_KEY_S && action == GLFW_PRESS) m_chip8->PressKey(8, 1);
-	else if (key == GLFW_KEY_D && action == GLFW_PRESS) m_chip8->PressKey(9, 1);
-	else if (key == GLFW_KEY_F && action == GLFW_PRESS) m_chip8->PressKey(14, 1);
+	else if (key == GLFW_KEY_A && action == GLFW_PRESS) PressKey(7, 1);
+	else if (key == GLFW_KEY_S && action == GLFW_PRESS) PressKey(8, 1);
+	else if (key == GLFW_KEY_D && action == GLFW_PRESS) PressKey(9, 1);
+	else if (key == GLFW_KEY_F && action == GLFW_PRESS) PressKey(14, 1);
 
 	//A, 0, B, F
-	else if (key == GLFW_KEY_Z && action == GLFW_PRESS) m_chip8->PressKey(10, 1);
-	else if (key == GLFW_KEY_X && action == GLFW_PRESS) m_chip8->PressKey(0, 1);
-	else if (key == GLFW_KEY_C && action == GLFW_PRESS) m_chip8->PressKey(11, 1);
-	else if (key == GLFW_KEY_V && action == GLFW_PRESS) m_chip8->PressKey(15, 1);
+	else if (key == GLFW_KEY_Z && action == GLFW_PRESS) PressKey(10, 1);
+	else if (key == GLFW_KEY_X && action == GLFW_PRESS) PressKey(0, 1);
+	else if (key == GLFW_KEY_C && action == GLFW_PRESS) PressKey(11, 1);
+	else if (key == GLFW_KEY_V && action == GLFW_PRESS) PressKey(15, 1);
 
 	//exit
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -327,12 +484,37 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	}
 
+	//play the game backwards while the key is held
+	if (key == GLFW_KEY_BACKSPACE && action != GLFW_REPEAT)
+	{
+		m_bRewinding = (action == GLFW_PRESS);
+	}
+
 	//reset current Game
 	if (key == GLFW_KEY_T && action == GLFW_PRESS)
 	{
 		ResetChip8();
 	}
 
+	//record a movie from the start of the game, the second press saves it next to the rom
+	if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+	{
+		if (m_bRecording)
+		{
+			StopRecording();
+		}
+		else
+		{
+			ResetChip8();
+			if (m_chip8->IsGameLoaded())
+			{
+				m_movie.Record(*m_chip8, MOVIE_KEYFRAME_INTERVAL);
+				m_bRecording = true;
+			}
+		}
+		glfwSetWindowTitle(m_Window, GetWindowTitle().c_str());
+	}
+
 	//Pause 
 	if (key == GLFW_KEY_P && action == GLFW_PRESS)
 	{
@@ -355,14 +537,49 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		glfwSetWindowTitle(m_Window, GetWindowTitle().c_str());
 	}
 
+	//switch between the interpreter backends
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+	{
+		switch (m_chip8->GetBackend())
+		{
+		case Chip8::BACKEND_INTERPRETER: m_chip8->SetBackend(Chip8::BACKEND_THREADED); break;
+		case Chip8::BACKEND_THREADED: m_chip8->SetBackend(Chip8::BACKEND_JIT); break;
+		default: m_chip8->SetBackend(Chip8::BACKEND_INTERPRETER); break;
+		}
+		glfwSetWindowTitle(m_Window, GetWindowTitle().c_str());
+	}
+
+	//cycle between Chip8, SuperChip, XO-CHIP and MegaChip and restart the game
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+	{
+		switch (m_chip8->GetMode())
+		{
+		case Chip8::MODE_CHIP8: m_chip8->SetMode(Chip8::MODE_SUPERCHIP); break;
+		case Chip8::MODE_SUPERCHIP: m_chip8->SetMode(Chip8::MODE_XOCHIP); break;
+		case Chip8::MODE_XOCHIP: m_chip8->SetMode(Chip8::MODE_MEGACHIP); break;
+		default: m_chip8->SetMode(Chip8::MODE_CHIP8); break;
+		}
+		ResetChip8();
+		glfwSetWindowTitle(m_Window, GetWindowTitle().c_str());
+	}
+
 	//Invert colors of the chip8
 	if (key == GLFW_KEY_I && action == GLFW_PRESS)
 	{
 		bInvertColors = !bInvertColors;
-		UpdateTexture(m_chip8);
+		UpdatePalette();
+		m_bRedraw = true;
 	}
 }
 
+//called whenever the window contents were damaged and have to be drawn again
+void refresh_callback(GLFWwindow* window)
+{
+	UNREFERENCED_PARAMETER(window);
+
+	m_bRedraw = true;
+}
+
 //called whenever a file gets dropped on the window
 void drop_callback(GLFWwindow* window,int amount, const char** files)
 {
@@ -370,38 +587,323 @@ void drop_callback(GLFWwindow* window,int amount, const char** files)
 	UNREFERENCED_PARAMETER(amount);
 
 	GAME = files[0]; //get first file
+
+	lock_guard<mutex> lock(m_chip8Mutex);
 	ResetChip8();
 	glfwSetWindowTitle(m_Window, GetWindowTitle().c_str());
 }
 
-//Copy the chip8 ScreenData to the openGL texture
-void UpdateTexture(Chip8 * chip8)
+//Copy the rows of the chip8 screen that changed to the openGL texture
+void UpdateTexture(const Frame& frame, U64 dirty)
 {	
-	const U8* graphics = chip8->GetScreenData();
-	//Set RGB channel of texture
-	for (auto x = 0; x < Chip8::WIDTH * Chip8::HEIGHT; x++)
+	const U64* rows = frame.rows[0];
+	int words = frame.width / 64;
+
+	//the game switched between lores, hires and the MegaChip screen
+	if (frame.width != m_screenWidth)
+	{
+		m_screenWidth = frame.width;
+		glUniform2i(m_screenSizeLocation, frame.width, frame.height);
+		glUniform1i(m_megaChipLocation, frame.bMegaChip ? 1 : 0);
+	}
+
+	if (frame.bMegaChip)
 	{
-		unsigned char w = WHITECOLOR;
-		unsigned char b = BLACKCOLOR;
+		glUniform1f(m_screenAlphaLocation, frame.alpha / 255.0f);
+	}
 
-		if(bInvertColors)
+	//take the next buffer of the ring, waiting for the upload that used it three frames ago if needed
+	PixelBuffer& pixels = m_pixelBuffers[m_pixelBufferIndex];
+	m_pixelBufferIndex = (m_pixelBufferIndex + 1) % PIXEL_BUFFER_COUNT;
+
+	if (pixels.fence)
+	{
+		glClientWaitSync(pixels.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(pixels.fence);
+		pixels.fence = nullptr;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixels.buffer);
+
+	void* pData = pixels.pMapped;
+	if (!pData)
+	{
+		//orphan the old storage so mapping doesn't wait for the driver
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, PIXEL_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+		pData = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, PIXEL_BUFFER_SIZE, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	//the packed screen is only a few hundred bytes, copying it is cheaper than copying the runs one by one
+	const void* screen = frame.bMegaChip ? static_cast<const void*>(frame.colors) : static_cast<const void*>(rows);
+	size_t screenSize = frame.bMegaChip ? sizeof(frame.colors) : sizeof(frame.rows);
+
+	const U8* source = nullptr;
+	if (pData)
+	{
+		memcpy(pData, screen, screenSize);
+		if (!pixels.pMapped) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else
+	{
+		//mapping failed, upload from client memory
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		source = static_cast<const U8*>(screen);
+	}
+
+	if (frame.bMegaChip)
+	{
+		//MegaChip games show a whole new screen with 00E0
+		glActiveTexture(GL_TEXTURE1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Chip8::MEGA_WIDTH, Chip8::MEGA_HEIGHT, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, source);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	else for (int plane = 0; plane < Chip8::PLANES; plane++)
+	{
+		const U8* planeSource = source + plane * Chip8::SCREEN_WORDS * sizeof(U64);
+		int planeY = plane * Chip8::HIRES_HEIGHT;
+
+		int y = 0;
+		while (y < frame.height)
 		{
-			unsigned char t = w;
-			w = b;
-			b = t;
+			if (((dirty >> y) & 1) == 0)
+			{
+				y++;
+				continue;
+			}
+
+			//find a run of changed rows
+			int first = y;
+			while (y < frame.height && ((dirty >> y) & 1) != 0)
+			{
+				y++;
+			}
+
+			//the packed rows are uploaded as they are, the shader expands the bits
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, planeY + first, frame.width / 32, y - first, GL_RED_INTEGER, GL_UNSIGNED_INT, planeSource + first * words * sizeof(U64));
 		}
+	}
+
+	if (pData)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		pixels.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
 
-		m_screenData[x][0] = m_screenData[x][1] = m_screenData[x][2] = graphics[x] == 1 ? w : b;
+//Create the pixel unpack buffers, persistently mapped when the driver supports it
+void CreatePixelBuffers()
+{
+	PFNBUFFERSTORAGEPROC bufferStorage = nullptr;
+	if (glfwExtensionSupported("GL_ARB_buffer_storage"))
+	{
+		bufferStorage = reinterpret_cast<PFNBUFFERSTORAGEPROC>(glfwGetProcAddress("glBufferStorage"));
 	}
 
-	//create the new texture
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, Chip8::WIDTH, Chip8::HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, m_screenData);
+	for (PixelBuffer& pixels : m_pixelBuffers)
+	{
+		pixels.pMapped = nullptr;
+		pixels.fence = nullptr;
+
+		glGenBuffers(1, &pixels.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixels.buffer);
+
+		if (bufferStorage)
+		{
+			//coherent, so the writes are visible to the upload without a flush
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_PIXEL_UNPACK_BUFFER, PIXEL_BUFFER_SIZE, nullptr, flags);
+			pixels.pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, PIXEL_BUFFER_SIZE, flags);
+		}
+		else
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, PIXEL_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_pixelBufferIndex = 0;
+}
+
+void DeletePixelBuffers()
+{
+	for (PixelBuffer& pixels : m_pixelBuffers)
+	{
+		if (pixels.fence) glDeleteSync(pixels.fence);
+		if (pixels.pMapped)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixels.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glDeleteBuffers(1, &pixels.buffer);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+//Set the colors of the pixels in the shader, one per combination of the two planes
+void UpdatePalette()
+{
+	float b = BLACKCOLOR / 255.0f;
+	float w = WHITECOLOR / 255.0f;
+
+	if(bInvertColors)
+	{
+		float t = w;
+		w = b;
+		b = t;
+	}
+
+	//pixels only set in the second plane or in both get shades in between
+	float second = (b * 2 + w) / 3;
+	float both = (b + w * 2) / 3;
+
+	GLfloat palette[] = { b, b, b, w, w, w, second, second, second, both, both, both };
+	glUniform3fv(m_paletteLocation, 4, palette);
 }
 
+//Reloads the game, the caller holds m_chip8Mutex.
+//Loading clears the screen, so the next frame the emulation thread publishes has every row dirty
 void ResetChip8()
 {
-	m_chip8->LoadGame(GAME.c_str());
-	UpdateTexture(m_chip8); //clear screen
+	LoadGame();
+}
+
+void LoadGame()
+{
+	//the movie ends where its game does
+	StopRecording();
+
+	bool bLoaded = m_chip8->LoadGame(GAME.c_str());
+
+	//the frames of the previous game can't be rewound into the new one
+	m_rewind.Reset(*m_chip8);
+
+	if (!bLoaded)
+	{
+		cout << "Chip8::Failed to open file: " << GAME << "!\n";
+		return;
+	}
+
+	//the hash identifies games that need compatibility flags
+	cerr << GAME.substr(GAME.find_last_of('\\') + 1) << ": " << m_chip8->GetGameHash() << endl;
+}
+
+//Presses a chip8 key and records it in the movie, the caller holds m_chip8Mutex
+void PressKey(int keyIndex, U8 pressed)
+{
+	m_chip8->PressKey(keyIndex, pressed);
+
+	if (m_bRecording)
+	{
+		m_movie.PressKey(keyIndex, pressed);
+	}
+}
+
+//Saves the movie that is being recorded, the caller holds m_chip8Mutex
+void StopRecording()
+{
+	if (!m_bRecording)
+	{
+		return;
+	}
+
+	m_bRecording = false;
+	string filename = GAME + ".c8m";
+	if (m_movie.Save(filename.c_str()))
+	{
+		cout << "Chip8::Saved " << m_movie.GetFrameCount() << " frames to " << filename << "\n";
+	}
+	else
+	{
+		cout << "Chip8::Failed to save movie: " << filename << "!\n";
+	}
+}
+
+//Runs the chip8 at 60 frames per second, independent of the refresh rate of the display.
+//Every frame that changed the screen is published to the render thread through m_frames, frames that
+//changed nothing don't wake the render thread at all
+void EmulationLoop()
+{
+	const chrono::microseconds FRAME_TIME(1000000 / 60);
+	chrono::steady_clock::time_point nextFrame = chrono::steady_clock::now();
+
+	Frame* pFrame = &m_frames.GetBack();
+	U64 frameNumber = 0;
+
+	while (m_bEmulating)
+	{
+		{
+			lock_guard<mutex> lock(m_chip8Mutex);
+
+			//every frame that ran is kept for rewinding and in the movie, frames spent paused are not.
+			//A rewound frame is taken out of the movie as well, it runs again with the input that follows
+			if (m_bRewinding)
+			{
+				if (m_rewind.Pop(*m_chip8) && m_bRecording)
+				{
+					m_movie.DropFrame();
+				}
+			}
+			else
+			{
+				U64 instructions = m_chip8->GetInstructionCount();
+				m_chip8->Run();
+
+				if (m_chip8->GetInstructionCount() != instructions)
+				{
+					m_rewind.Push(*m_chip8);
+
+					if (m_bRecording)
+					{
+						m_movie.EndFrame(*m_chip8);
+					}
+				}
+			}
+
+			if (m_chip8->shouldBeep())
+			{
+				m_bBeep = true;
+				glfwPostEmptyEvent();
+			}
+
+			U64 dirty = m_chip8->GetDirtyRows();
+			if (dirty != 0)
+			{
+				pFrame->bMegaChip = m_chip8->IsMegaChip();
+				pFrame->alpha = m_chip8->GetScreenAlpha();
+				if (pFrame->bMegaChip)
+				{
+					memcpy(pFrame->colors, m_chip8->GetMegaColors(), sizeof(pFrame->colors));
+				}
+				else for (int plane = 0; plane < Chip8::PLANES; plane++)
+				{
+					memcpy(pFrame->rows[plane], m_chip8->GetScreenRows(plane), sizeof(pFrame->rows[plane]));
+				}
+				pFrame->dirty = dirty;
+				pFrame->number = ++frameNumber;
+				pFrame->width = m_chip8->GetWidth();
+				pFrame->height = m_chip8->GetHeight();
+				m_chip8->ClearDirtyRows();
+
+				//a frame the render thread never took shows up there as a gap in the numbers
+				bool bSkipped;
+				pFrame = &m_frames.Publish(bSkipped);
+
+				//wake up the render thread
+				glfwPostEmptyEvent();
+			}
+		}
+
+		//don't try to catch up after a stall (debugger, suspended machine), just continue from now
+		nextFrame += FRAME_TIME;
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - nextFrame > FRAME_TIME * 4)
+		{
+			nextFrame = now;
+		}
+
+		this_thread::sleep_until(nextFrame);
+	}
 }
 
 string  GetWindowTitle()
@@ -409,13 +911,20 @@ string  GetWindowTitle()
 	int speed = (m_chip8)?m_chip8->GetRunSpeed():1;
 	int pos = GAME.find_last_of('\\');
 	string mode = "OFF";
+	string backend = "Interpreter";
+	string machine = "Chip8";
 	
 	if (m_chip8)
 	{
 		mode = m_chip8->GetCompatibilityMode() ? "ON" : "OFF";
+		const string backends[] = { "Interpreter", "Threaded", "JIT" };
+		backend = backends[m_chip8->GetBackend()];
+		const string machines[] = { "Chip8", "SuperChip", "XO-CHIP", "MegaChip" };
+		machine = machines[m_chip8->GetMode()];
 	}
 
 	string spd = (speed > 0) ?to_string(speed) : "[PAUSED]";
+	string recording = m_bRecording ? " [REC]" : "";
 	
-	return WINDOW_NAME + " - " + GAME.substr(pos + 1) + " - " + spd + " [Compatibility mode: " + mode + "]";
+	return WINDOW_NAME + " - " + GAME.substr(pos + 1) + " - " + spd + " [" + machine + "] [Compatibility mode: " + mode + "] [" + backend + "]" + recording;
 }
\ No newline at end of file
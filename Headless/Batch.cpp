@@ -0,0 +1,165 @@
+#include "Batch.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+struct BatchTask
+{
+	string romName;
+	bool bLoaded;
+	RunResult result;
+};
+
+//Roms have no extension or one of the Chip8 extensions, the Resources tree also contains readme files
+bool IsRom(const fs::path& path)
+{
+	string extension = path.extension().string();
+	transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+
+	return extension.empty() || extension == ".ch8" || extension == ".c8x" || extension == ".sc8" || extension == ".xo8";
+}
+
+vector<string> FindRoms(const string& directory)
+{
+	vector<string> roms;
+
+	error_code error;
+	for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+	{
+		if (it->is_regular_file() && IsRom(it->path()))
+		{
+			roms.push_back(it->path().generic_string());
+		}
+	}
+
+	//same order on every platform
+	sort(roms.begin(), roms.end());
+	return roms;
+}
+
+string EscapeCsv(const string& text)
+{
+	string escaped = "\"";
+	for (char c : text)
+	{
+		escaped += (c == '"') ? "\"\"" : string(1, c);
+	}
+	return escaped + "\"";
+}
+
+string EscapeJson(const string& text)
+{
+	string escaped = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+		}
+		escaped += c;
+	}
+	return escaped + "\"";
+}
+
+void WriteCsv(ostream& out, const vector<BatchTask>& tasks)
+{
+	out << "rom,loaded,rom_hash,instructions,seconds,instructions_per_second,screen_hash\n";
+	for (const BatchTask& task : tasks)
+	{
+		const RunResult& result = task.result;
+		double rate = result.seconds > 0 ? result.instructions / result.seconds : 0;
+
+		out << EscapeCsv(task.romName) << "," << (task.bLoaded ? 1 : 0) << "," << result.romHash << ","
+			<< result.instructions << "," << result.seconds << "," << rate << "," << result.screenHash << "\n";
+	}
+}
+
+void WriteJson(ostream& out, const vector<BatchTask>& tasks)
+{
+	out << "[\n";
+	for (size_t i = 0; i < tasks.size(); ++i)
+	{
+		const BatchTask& task = tasks[i];
+		const RunResult& result = task.result;
+		double rate = result.seconds > 0 ? result.instructions / result.seconds : 0;
+
+		out << "\t{ \"rom\": " << EscapeJson(task.romName) << ", \"loaded\": " << (task.bLoaded ? "true" : "false")
+			<< ", \"rom_hash\": " << result.romHash << ", \"instructions\": " << result.instructions
+			<< ", \"seconds\": " << result.seconds << ", \"instructions_per_second\": " << rate
+			<< ", \"screen_hash\": " << result.screenHash << " }" << (i + 1 < tasks.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
+
+int RunBatch(const BatchOptions& options)
+{
+	vector<string> roms = FindRoms(options.directory);
+
+	vector<BatchTask> tasks(roms.size());
+	for (size_t i = 0; i < roms.size(); ++i)
+	{
+		tasks[i].romName = roms[i];
+		tasks[i].bLoaded = false;
+	}
+
+	int threads = options.threads > 0 ? options.threads : static_cast<int>(thread::hardware_concurrency());
+	threads = max(1, min(threads, static_cast<int>(tasks.size())));
+
+	//every worker takes the next rom until all of them ran
+	atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < tasks.size(); i = next++)
+		{
+			unique_ptr<Chip8> chip8(new Chip8());
+			tasks[i].bLoaded = RunRom(*chip8, tasks[i].romName, options.run, tasks[i].result);
+		}
+	};
+
+	vector<thread> pool;
+	for (int i = 0; i < threads; ++i)
+	{
+		pool.emplace_back(worker);
+	}
+
+	for (thread& t : pool)
+	{
+		t.join();
+	}
+
+	ostringstream report;
+	if (options.bJson)
+	{
+		WriteJson(report, tasks);
+	}
+	else
+	{
+		WriteCsv(report, tasks);
+	}
+
+	if (options.output.empty())
+	{
+		cout << report.str();
+	}
+	else
+	{
+		ofstream file(options.output);
+		if (!file.is_open())
+		{
+			cout << "Batch::Failed to open file: " << options.output << "!\n";
+			return static_cast<int>(tasks.size());
+		}
+		file << report.str();
+	}
+
+	return static_cast<int>(count_if(tasks.begin(), tasks.end(), [](const BatchTask& task) { return !task.bLoaded; }));
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+
+#include "Runner.h"
+
+//Settings of a batch run over a directory tree
+struct BatchOptions
+{
+	std::string directory; //searched recursively for roms
+	std::string output; //file the report is written to, empty for the console
+	bool bJson; //JSON report instead of CSV
+	int threads; //worker threads, 0 uses one per hardware thread
+	RunOptions run;
+};
+
+//Runs every rom in the directory tree on a pool of threads with one Chip8 per rom.
+//Writes one report line per rom with the executed opcodes, the opcode rate, the wall time and the final screen hash.
+//Returns the number of roms that failed to load, or weren't recompiled when the backend is native.
+int RunBatch(const BatchOptions& options);
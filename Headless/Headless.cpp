@@ -0,0 +1,201 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "Runner.h"
+#include "Batch.h"
+
+//Runs Chip8 roms without a window, as fast as the host allows.
+//A single run prints the number of executed opcodes, the run time and a hash of the final screen,
+//so runs on display-less machines can be compared with each other. A batch run does the same for every
+//rom in a directory tree and writes the results as CSV or JSON. A replay runs the input of a movie recorded in the
+//emulator, up to any frame of it.
+
+using namespace std;
+
+void PrintUsage()
+{
+	cout << "Usage: Headless <rom> [options]\n"
+		<< "       Headless -batch <directory> [options]\n"
+		<< "       Headless <rom> -replay <movie> [-seek <frame>] [-backend <name>] [-screen]\n"
+		<< "  -frames <n>     number of frames to run (default 600)\n"
+		<< "  -speed <n>      opcodes per frame, 1 - 120 (default 10)\n"
+		<< "  -steps <n>      run n opcodes instead of frames\n"
+		<< "  -backend <name> interpreter, threaded, jit or native (default interpreter), native runs roms in CHIP8_NATIVE_ROMS\n"
+		<< "  -quirks <n>     Chip8::Quirk flags, overrides the flags picked from the rom hash\n"
+		<< "  -mode <name>    chip8, schip, xochip or megachip (default chip8)\n"
+		<< "  -seed <n>       seed of the random numbers, the same seed gives the same run (default 0)\n"
+		<< "  -screen         print the final screen\n"
+		<< "Replay options:\n"
+		<< "  -replay <movie> run the input recorded in the movie, with its mode, quirks, speed and seed\n"
+		<< "  -seek <frame>   stop at this frame, the replay starts at the keyframe before it (default the whole movie)\n"
+		<< "Batch options:\n"
+		<< "  -threads <n>    worker threads (default one per hardware thread)\n"
+		<< "  -format <name>  csv or json (default csv)\n"
+		<< "  -output <file>  write the report to a file instead of the console\n";
+}
+
+bool ParseMode(const string& name, Chip8::Mode& mode)
+{
+	if (name == "chip8") mode = Chip8::MODE_CHIP8;
+	else if (name == "schip") mode = Chip8::MODE_SUPERCHIP;
+	else if (name == "xochip") mode = Chip8::MODE_XOCHIP;
+	else if (name == "megachip") mode = Chip8::MODE_MEGACHIP;
+	else return false;
+
+	return true;
+}
+
+bool ParseBackend(const string& name, Chip8::Backend& backend)
+{
+	if (name == "interpreter") backend = Chip8::BACKEND_INTERPRETER;
+	else if (name == "threaded") backend = Chip8::BACKEND_THREADED;
+	else if (name == "jit") backend = Chip8::BACKEND_JIT;
+	else if (name == "native") backend = Chip8::BACKEND_NATIVE;
+	else return false;
+
+	return true;
+}
+
+void PrintScreen(Chip8& chip8)
+{
+	//one character per combination of the two XO-CHIP planes, MegaChip palette indices above that are all '#'
+	const char pixels[] = { '.', '#', '+', '*' };
+
+	const U8* screen = chip8.GetScreenData();
+	for (int y = 0; y < chip8.GetHeight(); ++y)
+	{
+		string row;
+		for (int x = 0; x < chip8.GetWidth(); ++x)
+		{
+			U8 pixel = screen[x + y * chip8.GetWidth()];
+			row += (pixel < 4) ? pixels[pixel] : '#';
+		}
+		cout << row << "\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	BatchOptions batch;
+	batch.bJson = false;
+	batch.threads = 0;
+
+	RunOptions& options = batch.run;
+	options.frames = 600;
+	options.speed = 10;
+	options.steps = 0;
+	options.quirks = -1;
+	options.seed = 0;
+	options.backend = Chip8::BACKEND_INTERPRETER;
+	options.mode = Chip8::MODE_CHIP8;
+
+	string romName;
+	string movieName;
+	int seekFrame = -1;
+	bool bBatch = false;
+	bool bPrintScreen = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string option = argv[i];
+		bool bHasValue = i + 1 < argc;
+
+		if (option == "-batch" && bHasValue) { batch.directory = argv[++i]; bBatch = true; }
+		else if (option == "-frames" && bHasValue) options.frames = atoi(argv[++i]);
+		else if (option == "-speed" && bHasValue) options.speed = atoi(argv[++i]);
+		else if (option == "-steps" && bHasValue) options.steps = atoll(argv[++i]);
+		else if (option == "-quirks" && bHasValue) options.quirks = atoi(argv[++i]);
+		else if (option == "-seed" && bHasValue) options.seed = strtoull(argv[++i], nullptr, 0);
+		else if (option == "-backend" && bHasValue && ParseBackend(argv[i + 1], options.backend)) ++i;
+		else if (option == "-mode" && bHasValue && ParseMode(argv[i + 1], options.mode)) ++i;
+		else if (option == "-threads" && bHasValue) batch.threads = atoi(argv[++i]);
+		else if (option == "-format" && bHasValue && (string(argv[i + 1]) == "csv" || string(argv[i + 1]) == "json")) batch.bJson = string(argv[++i]) == "json";
+		else if (option == "-output" && bHasValue) batch.output = argv[++i];
+		else if (option == "-replay" && bHasValue) movieName = argv[++i];
+		else if (option == "-seek" && bHasValue) seekFrame = atoi(argv[++i]);
+		else if (option == "-screen") bPrintScreen = true;
+		else if (option[0] != '-' && romName.empty()) romName = option;
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (bBatch)
+	{
+		return RunBatch(batch) == 0 ? 0 : 1;
+	}
+
+	if (romName.empty())
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Chip8 chip8;
+	RunResult result;
+	Movie movie;
+	if (!movieName.empty())
+	{
+		if (!movie.Load(movieName.c_str()))
+		{
+			cout << "Headless::Failed to load movie: " << movieName << "!\n";
+			return 1;
+		}
+
+		if (!ReplayMovie(chip8, romName, movie, seekFrame >= 0 ? seekFrame : movie.GetFrameCount(), options.backend, result))
+		{
+			if (result.bNoNativeRom)
+			{
+				cout << "Headless::No native blocks for rom: " << romName << ", add it to CHIP8_NATIVE_ROMS!\n";
+				return 1;
+			}
+
+			cout << "Headless::Movie " << movieName << " wasn't recorded with rom: " << romName << "!\n";
+			return 1;
+		}
+
+		options.seed = movie.GetSeed();
+	}
+	else if (!RunRom(chip8, romName, options, result))
+	{
+		if (result.bNoNativeRom)
+		{
+			cout << "Headless::No native blocks for rom: " << romName << ", add it to CHIP8_NATIVE_ROMS!\n";
+			return 1;
+		}
+
+		cout << "Headless::Failed to load rom: " << romName << "!\n";
+		return 1;
+	}
+
+	if (bPrintScreen)
+	{
+		PrintScreen(chip8);
+	}
+
+	cout << "rom: " << romName << "\n"
+		<< "rom hash: " << result.romHash << "\n"
+		<< "seed: " << options.seed << "\n";
+
+	if (!movieName.empty())
+	{
+		cout << "movie frames: " << movie.GetFrameCount() << "\n"
+			<< "replayed from frame: " << result.keyframe << "\n";
+	}
+
+	cout << "instructions: " << result.instructions << "\n"
+		<< "seconds: " << result.seconds << "\n"
+		<< "instructions per second: " << (result.seconds > 0 ? result.instructions / result.seconds : 0) << "\n"
+		<< "screen hash: " << result.screenHash << "\n";
+
+	return 0;
+}
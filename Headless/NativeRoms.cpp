@@ -0,0 +1,30 @@
+#include "NativeRoms.h"
+
+//NativeRomList.inc is written by CMake, one NATIVE_ROM(name) line per recompiled rom
+#define NATIVE_ROM(name) extern const Chip8::NativeRom name;
+#include "NativeRomList.inc"
+#undef NATIVE_ROM
+
+namespace
+{
+	const Chip8::NativeRom* const NATIVE_ROMS[] =
+	{
+#define NATIVE_ROM(name) &name,
+#include "NativeRomList.inc"
+#undef NATIVE_ROM
+		nullptr
+	};
+}
+
+const Chip8::NativeRom* FindNativeRom(unsigned int hash)
+{
+	for (const Chip8::NativeRom* const* rom = NATIVE_ROMS; *rom != nullptr; ++rom)
+	{
+		if ((*rom)->hash == hash)
+		{
+			return *rom;
+		}
+	}
+
+	return nullptr;
+}
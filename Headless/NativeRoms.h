@@ -0,0 +1,8 @@
+#pragma once
+
+#include "../Emulator/Chip8.h"
+
+//Roms recompiled ahead of time for the native backend. The build runs the Recompiler on every rom in the
+//CHIP8_NATIVE_ROMS CMake option and links the result, see CMakeLists.txt.
+//Returns the blocks generated from the rom with this hash, nullptr when the rom wasn't recompiled
+const Chip8::NativeRom* FindNativeRom(unsigned int hash);
@@ -0,0 +1,103 @@
+#include "Runner.h"
+#include <chrono>
+
+#include "NativeRoms.h"
+#include "../Emulator/Helpers.h"
+
+using namespace std;
+
+//Gives the native backend the blocks recompiled from the loaded rom. Without them every opcode would go through
+//the interpreter one at a time, slower than the interpreter backend, so the run fails instead
+bool UseNativeRom(Chip8& chip8, RunResult& result)
+{
+	if (chip8.GetBackend() != Chip8::BACKEND_NATIVE)
+	{
+		return true;
+	}
+
+	chip8.SetNativeRom(FindNativeRom(chip8.GetGameHash()));
+	result.bNoNativeRom = !chip8.HasNativeBlocks();
+	return !result.bNoNativeRom;
+}
+
+bool RunRom(Chip8& chip8, const string& romName, const RunOptions& options, RunResult& result)
+{
+	result = RunResult();
+
+	chip8.SetBackend(options.backend);
+	chip8.SetMode(options.mode);
+	chip8.SetSeed(options.seed);
+	if (!chip8.LoadGame(romName.c_str()))
+	{
+		return false;
+	}
+
+	if (options.quirks >= 0)
+	{
+		chip8.SetQuirks(options.quirks);
+	}
+	chip8.AdjustSpeed(options.speed - chip8.GetRunSpeed());
+
+	if (!UseNativeRom(chip8, result))
+	{
+		return false;
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	if (options.steps > 0)
+	{
+		//Step takes an int, run big counts in chunks
+		long long steps = options.steps;
+		while (steps > 0)
+		{
+			int count = steps > 0x10000000 ? 0x10000000 : static_cast<int>(steps);
+			chip8.Step(count);
+			steps -= count;
+		}
+	}
+	else
+	{
+		chip8.RunFrames(options.frames);
+	}
+
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.bLoaded = true;
+	result.romHash = chip8.GetGameHash();
+	result.instructions = chip8.GetInstructionCount();
+	result.screenHash = HashGen::Adler(reinterpret_cast<const char*>(chip8.GetScreenData()), chip8.GetWidth() * chip8.GetHeight());
+
+	return true;
+}
+
+bool ReplayMovie(Chip8& chip8, const string& romName, Movie& movie, int frames, Chip8::Backend backend, RunResult& result)
+{
+	result = RunResult();
+
+	chip8.SetBackend(backend);
+	if (!movie.Start(chip8, romName.c_str()) || !UseNativeRom(chip8, result))
+	{
+		return false;
+	}
+
+	if (frames > movie.GetFrameCount())
+	{
+		frames = movie.GetFrameCount();
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	result.keyframe = movie.Seek(chip8, frames);
+	for (int frame = result.keyframe; frame < frames; frame++)
+	{
+		movie.PlayFrame(chip8, frame);
+	}
+
+	result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	result.bLoaded = true;
+	result.romHash = chip8.GetGameHash();
+	result.instructions = chip8.GetInstructionCount();
+	result.screenHash = HashGen::Adler(reinterpret_cast<const char*>(chip8.GetScreenData()), chip8.GetWidth() * chip8.GetHeight());
+
+	return true;
+}
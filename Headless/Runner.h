@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+
+#include "../Emulator/Chip8.h"
+#include "../Emulator/Movie.h"
+
+//Settings of a headless run
+struct RunOptions
+{
+	int frames; //frames to run when steps is 0
+	int speed; //opcodes per frame
+	long long steps; //opcodes to run instead of frames
+	int quirks; //Chip8::Quirk flags, -1 keeps the flags picked from the rom hash
+	U64 seed; //CXNN random numbers, runs with the same seed are identical
+	Chip8::Mode mode;
+	Chip8::Backend backend;
+};
+
+//Result of a headless run
+struct RunResult
+{
+	bool bLoaded;
+	unsigned int romHash;
+	U64 instructions;
+	double seconds;
+	unsigned int screenHash;
+	int keyframe; //frame a movie replay started from
+	bool bNoNativeRom; //the native backend was picked but the rom wasn't recompiled for this mode and these quirks
+};
+
+//Loads the rom in chip8 and runs it without a window, returns false when the rom can't be loaded or the native
+//backend has no blocks for it
+bool RunRom(Chip8& chip8, const std::string& romName, const RunOptions& options, RunResult& result);
+
+//Replays the first frames of a movie recorded with romName, from the keyframe before them.
+//Returns false when the rom can't be loaded or isn't the one the movie was recorded with
+bool ReplayMovie(Chip8& chip8, const std::string& romName, Movie& movie, int frames, Chip8::Backend backend, RunResult& result);
@@ -0,0 +1,369 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <cctype>
+
+#include "../Emulator/Helpers.h"
+
+//Recompiles a Chip8 rom ahead of time into a C++ translation unit.
+//Every basic block that can be reached from the start of the rom becomes one function, the result is
+//linked into the emulator and registered with Chip8::SetNativeRom. Blocks end at the same opcodes as the
+//jit blocks: jumps, calls, returns, skips, BNNN, DXYN, FX0A and memory writes.
+//Indirect jumps (BNNN) and code that gets overwritten at runtime use the interpreter.
+
+using namespace std;
+
+typedef unsigned char U8;
+typedef unsigned short U16;
+
+const int MEMORY_SIZE = 4096;
+const int START_ADDRESS = 0x200;
+const int MAX_BLOCK_LENGTH = 64;
+
+struct Opcode
+{
+	U16 opcode;
+	U16 nnn;
+	U8 x, y, n, nn;
+};
+
+Opcode Decode(const U8* memory, int address)
+{
+	Opcode op;
+	op.opcode = static_cast<U16>((memory[address] << 8) | memory[address + 1]);
+	op.nnn = op.opcode & 0x0FFF;
+	op.x = (op.opcode & 0x0F00) >> 8;
+	op.y = (op.opcode & 0x00F0) >> 4;
+	op.n = op.opcode & 0x000F;
+	op.nn = op.opcode & 0x00FF;
+	return op;
+}
+
+//true for opcodes the interpreter doesn't know, the memory position doesn't change on those
+bool IsUnknown(U16 opcode)
+{
+	//SuperChip opcodes
+	if ((opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF))
+	{
+		return false;
+	}
+
+	//MegaChip opcodes are left to the interpreter, 01NN NNNN is 4 bytes long
+	if (opcode == 0x0010 || opcode == 0x0011 || (opcode & 0xFFF0) == 0x00B0 || (opcode >= 0x0100 && opcode <= 0x09FF))
+	{
+		return true;
+	}
+
+	switch (opcode & 0xF000)
+	{
+	case 0x0000: return (opcode & 0x000F) != 0x0 && (opcode & 0x000F) != 0xE;
+	case 0x8000: return (opcode & 0x000F) > 0x7 && (opcode & 0x000F) != 0xE;
+	case 0xE000: return (opcode & 0x00FF) != 0x9E && (opcode & 0x00FF) != 0xA1;
+	case 0xF000:
+		switch (opcode & 0x00FF)
+		{
+		case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x30: case 0x33: case 0x55: case 0x65: case 0x75: case 0x85:
+			return false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+bool EndsBlock(U16 opcode)
+{
+	if (IsUnknown(opcode))
+	{
+		return true;
+	}
+
+	switch (opcode & 0xF000)
+	{
+	case 0x0000: return ((opcode & 0x000F) == 0xE && opcode != 0x00FE) || opcode == 0x00FD; //00EE, 00FD stays at its own address
+	case 0x1000: case 0x2000: case 0x3000: case 0x4000: case 0x9000: case 0xB000: case 0xD000: case 0xE000:
+		return true;
+	case 0x5000: //5XY2 writes memory like FX55, 5XY3 only reads it
+		return (opcode & 0x000F) != 0x3;
+	case 0xF000:
+		return (opcode & 0x00FF) == 0x0A || (opcode & 0x00FF) == 0x33 || (opcode & 0x00FF) == 0x55;
+	}
+
+	return false;
+}
+
+//Addresses execution can continue at after the opcode that ends a block
+void AddSuccessors(const Opcode& op, int address, vector<int>& entries)
+{
+	switch (op.opcode & 0xF000)
+	{
+	case 0x0000: //00EE returns to an address that was recorded at the call, 00FD doesn't continue
+		break;
+	case 0x1000:
+		entries.push_back(op.nnn);
+		break;
+	case 0x2000:
+		entries.push_back(op.nnn);
+		entries.push_back(address + 2);
+		break;
+	case 0x3000: case 0x4000: case 0x9000: case 0xE000:
+		entries.push_back(address + 2);
+		entries.push_back(address + 4);
+		break;
+	case 0x5000: //5XY2 doesn't skip
+		entries.push_back(address + 2);
+		if (op.n != 0x2)
+		{
+			entries.push_back(address + 4);
+		}
+		break;
+	case 0xB000: //indirect jump, the target is only known at runtime
+		break;
+	default:
+		entries.push_back(address + 2);
+		break;
+	}
+}
+
+string Hex(int value, int digits)
+{
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+	return buffer;
+}
+
+//State a block accesses, only that gets declared in the block function
+struct BlockState
+{
+	bool bRegisters, bIndex, bPosition;
+};
+
+//Marks the state a translated opcode accesses
+void UpdateState(const Opcode& op, BlockState& state)
+{
+	//registers are used by everything except the jump and ANNN
+	U16 group = op.opcode & 0xF000;
+	state.bRegisters |= group != 0x1000 && group != 0xA000;
+	state.bIndex |= group == 0xA000 || (group == 0xF000 && (op.nn == 0x1E || op.nn == 0x29));
+	state.bPosition |= group != 0x6000 && group != 0x7000 && group != 0x8000 && group != 0xA000 && group != 0xF000;
+}
+
+//C++ statements for one opcode, returns false when the interpreter has to execute it
+bool Translate(const Opcode& op, int address, ostream& out)
+{
+	if (IsUnknown(op.opcode))
+	{
+		return false;
+	}
+
+	string vx = "V[" + Hex(op.x, 1) + "]";
+	string vy = "V[" + Hex(op.y, 1) + "]";
+	string next = Hex(address + 2, 4);
+	string skip = Hex(address + 4, 4);
+
+	switch (op.opcode & 0xF000)
+	{
+	case 0x1000: out << "PC = " << Hex(op.nnn, 4) << ";"; return true;
+	case 0x3000: out << "PC = (" << vx << " == " << Hex(op.nn, 2) << ") ? " << skip << " : " << next << ";"; return true;
+	case 0x4000: out << "PC = (" << vx << " != " << Hex(op.nn, 2) << ") ? " << skip << " : " << next << ";"; return true;
+	case 0x5000: //5XY2 and 5XY3 store and load registers, they and the rarely used other 5XYN are left to the interpreter
+		if (op.n == 0x0)
+		{
+			out << "PC = (" << vx << " == " << vy << ") ? " << skip << " : " << next << ";";
+			return true;
+		}
+		return false;
+	case 0x6000: out << vx << " = " << Hex(op.nn, 2) << ";"; return true;
+	case 0x7000: out << vx << " += " << Hex(op.nn, 2) << ";"; return true;
+	case 0x8000:
+		switch (op.n)
+		{
+		case 0x0: out << vx << " = " << vy << ";"; return true;
+		case 0x1: out << vx << " |= " << vy << ";"; return true;
+		case 0x2: out << vx << " &= " << vy << ";"; return true;
+		case 0x3: out << vx << " ^= " << vy << ";"; return true;
+		case 0x4: out << "{ U8 x = " << vx << ", y = " << vy << "; V[0xF] = (x + y > 0xFF) ? 1 : 0; " << vx << " += y; }"; return true;
+		case 0x5: out << "{ U8 x = " << vx << ", y = " << vy << "; V[0xF] = (y > x) ? 0 : 1; " << vx << " = x - y; }"; return true;
+		case 0x6: out << "{ U8 x = " << vx << "; V[0xF] = x & 0x1; " << vx << " = x >> 1; }"; return true;
+		case 0x7: out << "{ U8 x = " << vx << ", y = " << vy << "; V[0xF] = (x > y) ? 0 : 1; " << vx << " = y - x; }"; return true;
+		case 0xE: out << "{ U8 x = " << vx << "; V[0xF] = x & 0x1; " << vx << " = x << 1; }"; return true;
+		}
+		return false;
+	case 0x9000: out << "PC = (" << vx << " != " << vy << ") ? " << skip << " : " << next << ";"; return true;
+	case 0xA000: out << "I = " << Hex(op.nnn, 4) << ";"; return true;
+	case 0xD000: out << "Chip8Native::DrawSprite(chip8, " << vx << ", " << vy << ", " << (int)op.n << "); PC = " << next << ";"; return true;
+	case 0xE000:
+		if (op.nn == 0x9E)
+		{
+			out << "PC = Chip8Native::IsKeyPressed(chip8, " << vx << ") ? " << skip << " : " << next << ";";
+			return true;
+		}
+		out << "PC = !Chip8Native::IsKeyPressed(chip8, " << vx << ") ? " << skip << " : " << next << ";";
+		return true;
+	case 0xF000:
+		switch (op.nn)
+		{
+		case 0x07: out << vx << " = Chip8Native::DelayTimer(chip8);"; return true;
+		case 0x15: out << "Chip8Native::DelayTimer(chip8) = " << vx << ";"; return true;
+		case 0x18: out << "Chip8Native::SoundTimer(chip8) = " << vx << ";"; return true;
+		case 0x1E: out << "I = (I + " << vx << ") & Chip8Native::IndexMask(chip8);"; return true;
+		case 0x29: out << "I = static_cast<U16>(" << vx << " * 5);"; return true;
+		}
+		return false;
+	}
+
+	return false;
+}
+
+//Writes the function of the block starting at address, returns the number of opcodes in the block
+int WriteBlock(const U8* memory, int address, ostream& out, vector<int>& entries)
+{
+	ostringstream body;
+	BlockState state = {};
+	int length = 0;
+	int position = address;
+	bool bPositionStored = false;
+
+	while (length < MAX_BLOCK_LENGTH && position < MEMORY_SIZE - 1)
+	{
+		Opcode op = Decode(memory, position);
+
+		body << "\t\t//" << Hex(position, 4) << ": " << Hex(op.opcode, 4) << "\n\t\t";
+		if (Translate(op, position, body))
+		{
+			UpdateState(op, state);
+			bPositionStored = EndsBlock(op.opcode);
+		}
+		else
+		{
+			body << "Chip8Native::Execute(chip8, " << Hex(position, 4) << ", " << Hex(op.opcode, 4) << ");";
+			bPositionStored = true;
+		}
+		body << "\n";
+
+		length++;
+		if (EndsBlock(op.opcode))
+		{
+			AddSuccessors(op, position, entries);
+			break;
+		}
+
+		position += 2;
+		if (length == MAX_BLOCK_LENGTH)
+		{
+			entries.push_back(position);
+		}
+	}
+
+	if (length == 0)
+	{
+		return 0;
+	}
+
+	if (!bPositionStored)
+	{
+		body << "\t\tPC = " << Hex(position, 4) << ";\n";
+		state.bPosition = true;
+	}
+
+	out << "\tvoid Block_" << Hex(address, 4).substr(2) << "(Chip8& chip8)\n\t{\n";
+	if (state.bRegisters) out << "\t\tU8* V = Chip8Native::Registers(chip8);\n";
+	if (state.bIndex) out << "\t\tU32& I = Chip8Native::Index(chip8);\n";
+	if (state.bPosition) out << "\t\tU16& PC = Chip8Native::Position(chip8);\n";
+	out << "\n" << body.str() << "\t}\n\n";
+
+	return length;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		cout << "Usage: Recompiler <rom> <output.cpp> [name]\n";
+		return 1;
+	}
+
+	string romName = argv[1];
+	string outputName = argv[2];
+
+	//name of the NativeRom the translation unit exports, defaults to the file name of the rom
+	string name = (argc > 3) ? argv[3] : romName.substr(romName.find_last_of("\\/") + 1);
+	for (auto& c : name)
+	{
+		c = isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(toupper(c)) : '_';
+	}
+
+	ifstream file(romName, ios::binary);
+	if (!file.is_open())
+	{
+		cout << "Recompiler::Failed to open file: " << romName << "!\n";
+		return 1;
+	}
+
+	vector<char> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if (rom.empty() || rom.size() > MEMORY_SIZE - START_ADDRESS)
+	{
+		cout << "Recompiler::Invalid rom size: " << rom.size() << "!\n";
+		return 1;
+	}
+
+	//same hash the emulator computes when it loads the rom
+	unsigned int hash = HashGen::Adler(rom.data(), static_cast<int>(rom.size()));
+
+	U8 memory[MEMORY_SIZE] = {};
+	for (size_t i = 0; i < rom.size(); ++i)
+	{
+		memory[START_ADDRESS + i] = static_cast<U8>(rom[i]);
+	}
+
+	//recover the blocks that can be reached from the start address
+	ostringstream blocks;
+	vector<pair<int, int>> table;
+	set<int> visited;
+	vector<int> entries;
+	entries.push_back(START_ADDRESS);
+
+	while (!entries.empty())
+	{
+		int address = entries.back();
+		entries.pop_back();
+
+		//only code inside the rom, odd addresses are valid
+		if (address < START_ADDRESS || address >= START_ADDRESS + static_cast<int>(rom.size()) || !visited.insert(address).second)
+		{
+			continue;
+		}
+
+		int length = WriteBlock(memory, address, blocks, entries);
+		if (length > 0)
+		{
+			table.push_back(make_pair(address, length));
+		}
+	}
+
+	ofstream out(outputName);
+	if (!out.is_open())
+	{
+		cout << "Recompiler::Failed to open file: " << outputName << "!\n";
+		return 1;
+	}
+
+	out << "//Generated by the Recompiler from " << romName.substr(romName.find_last_of("\\/") + 1) << ", do not edit\n";
+	out << "#include \"Chip8Native.h\"\n\n";
+	out << "namespace\n{\n";
+	out << blocks.str();
+	out << "\tconst Chip8::NativeBlock BLOCKS[] =\n\t{\n";
+	for (auto& entry : table)
+	{
+		out << "\t\t{ " << Hex(entry.first, 4) << ", " << entry.second << ", &Block_" << Hex(entry.first, 4).substr(2) << " },\n";
+	}
+	out << "\t};\n}\n\n";
+	out << "extern const Chip8::NativeRom NATIVE_" << name << " = { " << hash << "u, BLOCKS, " << table.size() << " };\n";
+
+	cout << romName << ": " << table.size() << " blocks, hash " << hash << "\n";
+	return 0;
+}
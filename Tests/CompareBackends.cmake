@@ -0,0 +1,28 @@
+#Runs a rom with Headless on every backend and fails when one of them exits with an error, or ends with another opcode count
+#or screen hash than the first backend. ctest passes HEADLESS, ROM, BACKENDS and ARGS with -D, BACKENDS and ARGS separated
+#by spaces because ctest splits lists into separate arguments
+separate_arguments(BACKENDS UNIX_COMMAND "${BACKENDS}")
+separate_arguments(ARGS UNIX_COMMAND "${ARGS}")
+
+foreach(backend ${BACKENDS})
+	execute_process(
+		COMMAND ${HEADLESS} ${ROM} -backend ${backend} ${ARGS}
+		RESULT_VARIABLE result
+		OUTPUT_VARIABLE output
+		ERROR_VARIABLE output
+	)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${backend} failed (${result}):\n${output}")
+	endif()
+
+	string(REGEX MATCH "instructions: [0-9]+" instructions "${output}")
+	string(REGEX MATCH "screen hash: [0-9]+" screen "${output}")
+	message(STATUS "${backend}: ${instructions}, ${screen}")
+
+	if(NOT DEFINED expected)
+		set(expected "${instructions}, ${screen}")
+		set(first ${backend})
+	elseif(NOT "${instructions}, ${screen}" STREQUAL expected)
+		message(FATAL_ERROR "${backend} ended with ${instructions}, ${screen}, ${first} with ${expected}")
+	endif()
+endforeach()
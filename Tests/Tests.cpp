@@ -0,0 +1,369 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "../Emulator/Chip8.h"
+#include "../Emulator/ForkPool.h"
+#include "../Emulator/RewindBuffer.h"
+
+//Round trips of the emulator core that ctest runs on a few roms. Every test plays the same scripted input, compares
+//the snapshots it gets back with the ones it saved and prints what differs. The backends are compared with each other
+//by CompareBackends.cmake, which runs Headless.
+
+using namespace std;
+
+struct TestOptions
+{
+	string romName;
+	Chip8::Mode mode;
+	Chip8::Backend backend;
+	int speed;
+};
+
+void PrintUsage()
+{
+	cout << "Usage: Tests <test> <rom> [options]\n"
+		<< "Tests:\n"
+		<< "  state           SaveState, LoadState and running on gives the same state as running on without them\n"
+		<< "  corruptstate    LoadState rejects damaged snapshots without changing the chip8, or runs the ones it accepts\n"
+		<< "  rewind          RewindBuffer pops every pushed frame back in order\n"
+		<< "  fork            ForkPool restores every fork, and a fork runs on like a LoadState of it\n"
+		<< "Options:\n"
+		<< "  -mode <name>    chip8, schip, xochip or megachip (default chip8)\n"
+		<< "  -backend <name> interpreter, threaded or jit (default interpreter)\n"
+		<< "  -speed <n>      opcodes per frame, 1 - 120 (default 20)\n";
+}
+
+bool ParseMode(const string& name, Chip8::Mode& mode)
+{
+	if (name == "chip8") mode = Chip8::MODE_CHIP8;
+	else if (name == "schip") mode = Chip8::MODE_SUPERCHIP;
+	else if (name == "xochip") mode = Chip8::MODE_XOCHIP;
+	else if (name == "megachip") mode = Chip8::MODE_MEGACHIP;
+	else return false;
+
+	return true;
+}
+
+bool ParseBackend(const string& name, Chip8::Backend& backend)
+{
+	if (name == "interpreter") backend = Chip8::BACKEND_INTERPRETER;
+	else if (name == "threaded") backend = Chip8::BACKEND_THREADED;
+	else if (name == "jit") backend = Chip8::BACKEND_JIT;
+	else return false;
+
+	return true;
+}
+
+//Helpers
+#pragma region Helpers
+bool LoadRom(Chip8& chip8, const TestOptions& options)
+{
+	chip8.SetMode(options.mode);
+	chip8.SetBackend(options.backend);
+	chip8.SetSeed(1);
+	if (!chip8.LoadGame(options.romName.c_str()))
+	{
+		cout << "Tests::Failed to load rom: " << options.romName << "!\n";
+		return false;
+	}
+
+	chip8.AdjustSpeed(options.speed - chip8.GetRunSpeed());
+	return true;
+}
+
+vector<U8> SaveState(Chip8& chip8)
+{
+	vector<U8> state(chip8.GetStateSize());
+	chip8.SaveState(state.data());
+	return state;
+}
+
+//Runs one frame with input that only depends on the frame number, so two runs of the same frames get the same keys
+void RunFrame(Chip8& chip8, int frame)
+{
+	chip8.PressKey((frame / 16) & 0xF, (frame & 15) < 8);
+	chip8.Run();
+}
+
+void RunFrames(Chip8& chip8, int first, int count)
+{
+	for (int frame = first; frame < first + count; ++frame)
+	{
+		RunFrame(chip8, frame);
+	}
+}
+#pragma endregion
+
+//Tests
+#pragma region Tests
+bool TestState(const TestOptions& options)
+{
+	Chip8 chip8, copy;
+	if (!LoadRom(chip8, options) || !LoadRom(copy, options))
+	{
+		return false;
+	}
+
+	RunFrames(chip8, 0, 120);
+	vector<U8> snapshot = SaveState(chip8);
+	RunFrames(chip8, 120, 240);
+
+	if (!copy.LoadState(snapshot.data(), static_cast<int>(snapshot.size())))
+	{
+		cout << "Tests::LoadState rejected a snapshot SaveState wrote!\n";
+		return false;
+	}
+
+	if (SaveState(copy) != snapshot)
+	{
+		cout << "Tests::SaveState after LoadState wrote another snapshot!\n";
+		return false;
+	}
+
+	RunFrames(copy, 120, 240);
+	if (SaveState(copy) != SaveState(chip8))
+	{
+		cout << "Tests::Running on from a loaded snapshot ended in another state!\n";
+		return false;
+	}
+
+	//a snapshot of the wrong size is rejected before anything is copied
+	vector<U8> before = SaveState(copy);
+	if (copy.LoadState(snapshot.data(), static_cast<int>(snapshot.size()) - 1) || SaveState(copy) != before)
+	{
+		cout << "Tests::LoadState accepted a truncated snapshot!\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool TestCorruptState(const TestOptions& options)
+{
+	Chip8 chip8;
+	if (!LoadRom(chip8, options))
+	{
+		return false;
+	}
+
+	RunFrames(chip8, 0, 60);
+	vector<U8> snapshot = SaveState(chip8);
+
+	//the registers, I, the stack and the mode settings are at the start of a snapshot, movie files can hold any value there
+	const U8 values[] = { 0x02, 0x7F, 0x80, 0xFF };
+	int accepted = 0;
+	int size = static_cast<int>(snapshot.size()) < 256 ? static_cast<int>(snapshot.size()) : 256;
+	for (int position = 0; position < size; ++position)
+	{
+		for (U8 value : values)
+		{
+			vector<U8> corrupt = snapshot;
+			corrupt[position] = value;
+
+			vector<U8> before = SaveState(chip8);
+			if (!chip8.LoadState(corrupt.data(), static_cast<int>(corrupt.size())))
+			{
+				if (SaveState(chip8) != before)
+				{
+					cout << "Tests::LoadState changed the chip8 while rejecting byte " << position << "!\n";
+					return false;
+				}
+				continue;
+			}
+
+			//whatever the snapshot held, running it stays inside the buffers of the chip8
+			accepted++;
+			RunFrames(chip8, 60, 30);
+		}
+
+		chip8.LoadState(snapshot.data(), static_cast<int>(snapshot.size()));
+	}
+
+	cout << "accepted snapshots: " << accepted << "\n";
+	return true;
+}
+
+bool TestRewind(const TestOptions& options)
+{
+	Chip8 chip8;
+	if (!LoadRom(chip8, options))
+	{
+		return false;
+	}
+
+	//a small ring, so the oldest checkpoints are dropped while the test pushes
+	RewindBuffer rewind(16 * 1024, 600);
+	rewind.Reset(chip8);
+
+	vector<vector<U8>> states;
+	states.push_back(SaveState(chip8));
+	for (int frame = 0; frame < 600; ++frame)
+	{
+		RunFrame(chip8, frame);
+		rewind.Push(chip8);
+		states.push_back(SaveState(chip8));
+	}
+
+	//every pop goes back one frame, up to the oldest checkpoint that is still in the ring
+	int popped = 0;
+	int frame = static_cast<int>(states.size()) - 1;
+	while (rewind.Pop(chip8))
+	{
+		popped++;
+		frame--;
+		if (frame < 0 || SaveState(chip8) != states[frame])
+		{
+			cout << "Tests::Pop " << popped << " didn't go back to frame " << frame << "!\n";
+			return false;
+		}
+	}
+
+	if (popped == 0)
+	{
+		cout << "Tests::Nothing could be popped!\n";
+		return false;
+	}
+
+	//pushing again after the pops continues from the frame the pops stopped at
+	RunFrames(chip8, frame, 60);
+	rewind.Push(chip8);
+	vector<U8> after = SaveState(chip8);
+	RunFrame(chip8, frame + 60);
+	rewind.Push(chip8);
+	if (!rewind.Pop(chip8) || SaveState(chip8) != after)
+	{
+		cout << "Tests::Pop after popping everything didn't go back one frame!\n";
+		return false;
+	}
+
+	cout << "popped frames: " << popped << "\n";
+	return true;
+}
+
+bool TestFork(const TestOptions& options)
+{
+	Chip8 chip8, check;
+	if (!LoadRom(chip8, options) || !LoadRom(check, options))
+	{
+		return false;
+	}
+
+	RunFrames(chip8, 0, 30);
+	ForkPool pool(chip8);
+
+	struct Fork
+	{
+		int id;
+		int frame;
+		vector<U8> state;
+	};
+
+	vector<Fork> forks;
+	forks.push_back({ pool.Fork(), 30, SaveState(chip8) });
+
+	//branch random forks a few frames further, the pool shares the pages the branches don't write
+	mt19937 random(1);
+	for (int i = 0; i < 2000; ++i)
+	{
+		Fork& fork = forks[random() % forks.size()];
+		pool.Restore(fork.id);
+		if (SaveState(chip8) != fork.state)
+		{
+			cout << "Tests::Restore " << i << " didn't put back the state of its fork!\n";
+			return false;
+		}
+
+		int frame = fork.frame;
+		int frames = 1 + random() % 3;
+		RunFrames(chip8, frame, frames);
+
+		//the same frames from a snapshot of the fork end in the same state
+		if (i % 8 == 0)
+		{
+			check.LoadState(fork.state.data(), static_cast<int>(fork.state.size()));
+			RunFrames(check, frame, frames);
+			if (SaveState(check) != SaveState(chip8))
+			{
+				cout << "Tests::Running on from fork " << fork.id << " differs from running on from its snapshot!\n";
+				return false;
+			}
+		}
+
+		if (random() % 3 != 0)
+		{
+			forks.push_back({ pool.Fork(), frame + frames, SaveState(chip8) });
+		}
+
+		if (forks.size() > 100)
+		{
+			int released = random() % forks.size();
+			pool.Release(forks[released].id);
+			forks.erase(forks.begin() + released);
+		}
+	}
+
+	//every page goes back to the pool once the forks are released
+	int pages = pool.GetPageCount();
+	for (const Fork& fork : forks)
+	{
+		pool.Release(fork.id);
+	}
+
+	if (pool.GetForkCount() != 0)
+	{
+		cout << "Tests::" << pool.GetForkCount() << " forks are left after releasing all of them!\n";
+		return false;
+	}
+
+	cout << "pages: " << pages << " -> " << pool.GetPageCount() << "\n";
+	return true;
+}
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	string test = argv[1];
+
+	TestOptions options;
+	options.romName = argv[2];
+	options.mode = Chip8::MODE_CHIP8;
+	options.backend = Chip8::BACKEND_INTERPRETER;
+	options.speed = 20;
+
+	for (int i = 3; i < argc; ++i)
+	{
+		string option = argv[i];
+		bool bHasValue = i + 1 < argc;
+
+		if (option == "-mode" && bHasValue && ParseMode(argv[i + 1], options.mode)) ++i;
+		else if (option == "-backend" && bHasValue && ParseBackend(argv[i + 1], options.backend)) ++i;
+		else if (option == "-speed" && bHasValue) options.speed = atoi(argv[++i]);
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	bool bPassed;
+	if (test == "state") bPassed = TestState(options);
+	else if (test == "corruptstate") bPassed = TestCorruptState(options);
+	else if (test == "rewind") bPassed = TestRewind(options);
+	else if (test == "fork") bPassed = TestFork(options);
+	else
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	return bPassed ? 0 : 1;
+}